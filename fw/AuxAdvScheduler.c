@@ -9,6 +9,8 @@
 
 // My includes
 #include <AuxAdvScheduler.h>
+#include <perf_counters.h>
+#include <csa2.h>
 
 struct AuxSchedInfo
 {
@@ -16,214 +18,424 @@ struct AuxSchedInfo
     PHY_Mode phy;
     uint32_t radio_time; // start time
     uint32_t duration; // in radio ticks
+    uint32_t aa;
+    uint32_t crcInit;
 };
 
-#define MAX_AUX_EVENTS 8
+// periodic advertising train (AUX_SYNC_IND) being followed
+struct PeriodicTrain
+{
+    CSA2_Context hop;
+    uint32_t aa;
+    uint32_t crcInit;
+    PHY_Mode phy;
+    uint16_t scaPpm;        // advertiser sleep clock accuracy
+    uint16_t eventCounter;  // paEventCounter of next event
+    uint16_t missed;        // consecutive events without a received packet
+    uint32_t interval;      // radio ticks
+    uint32_t anchor;        // radio time of last received (or advertised) packet
+    uint32_t eventTime;     // expected radio time of next event
+    bool queued;            // next event has been added to the heap
+    bool active;
+};
+
+#define ADV_AA 0x8E89BED6
+#define ADV_CRCI 0x555555
+
+#define MAX_PERIODIC_TRAINS 4
+
+// give up on a train after this many consecutive missed events
+#define PERIODIC_MAX_MISSES 16
+
+// our own clock accuracy, added to the advertiser's for window widening
+#define LOCAL_SCA_PPM 50
 
-// non-periodic
-static struct AuxSchedInfo aux_events[MAX_AUX_EVENTS];
+// be ready this long before the earliest expected packet start
+#define PERIODIC_MARGIN_TICKS (500 * 4)
+
+static struct PeriodicTrain trains[MAX_PERIODIC_TRAINS];
+
+// may be overridden at build time (eg. -DAUX_SCHED_CAPACITY=64)
+#ifndef AUX_SCHED_CAPACITY
+#define AUX_SCHED_CAPACITY 32
+#endif
+
+// non-periodic, binary min-heap ordered by start time
+static struct AuxSchedInfo aux_events[AUX_SCHED_CAPACITY];
 static uint32_t num_aux_events = 0;
 
-static int sched_event_cmp_fn(const void *a, const void *b)
+// wraparound safe radio time comparisons
+static inline bool time_before(uint32_t a, uint32_t b)
 {
-    const struct AuxSchedInfo *a_ = (const struct AuxSchedInfo *)a;
-    const struct AuxSchedInfo *b_ = (const struct AuxSchedInfo *)b;
-    return a_->radio_time - b_->radio_time;
+    return (int32_t)(a - b) < 0;
 }
 
-static void resort_sched(void)
+static inline bool event_started(const struct AuxSchedInfo *e, uint32_t radio_time)
 {
-    qsort(aux_events, num_aux_events, sizeof(struct AuxSchedInfo), sched_event_cmp_fn);
+    return (int32_t)(e->radio_time - radio_time) <= 0;
 }
 
-// we're not handling periodic advertising (AUX_SYNC_IND) for now
+static inline bool event_ended(const struct AuxSchedInfo *e, uint32_t radio_time)
+{
+    return (e->radio_time + e->duration) - radio_time >= 0x80000000;
+}
+
+static void heap_swap(uint32_t a, uint32_t b)
+{
+    struct AuxSchedInfo tmp = aux_events[a];
+    aux_events[a] = aux_events[b];
+    aux_events[b] = tmp;
+}
 
-// list order is early to late
-static bool insert_event_sorted(const struct AuxSchedInfo *event,
-        struct AuxSchedInfo *elist, uint32_t *num_events, uint32_t max_events)
+static void sift_up(uint32_t i)
 {
-    for (uint32_t i = 0; i < *num_events; i++)
+    while (i > 0)
     {
-        // not duplicate if not on same channel/phy
-        if ((elist[i].chan == event->chan) &&
-            (elist[i].phy == event->phy))
-        {
-            // deduplicate (check for overlap)
-            uint32_t start_a, start_b, end_a, end_b, offset;
-            start_a = elist[i].radio_time;
-            end_a = elist[i].radio_time + elist[i].duration;
-            start_b = event->radio_time;
-            end_b = event->radio_time + event->duration;
-
-            // offset calculation to simplify handling of wraparound
-            if (start_b - start_a >= 0x80000000) // b before a
-                offset = start_b;
-            else
-                offset = start_a;
-            start_a -= offset;
-            start_b -= offset;
-            end_a -= offset;
-            end_b -= offset;
-
-            // now actually check for overlap
-            // Note: this logic doesn't handle merging events, but that's OK
-            if (start_b < start_a)
-            {
-                // Case A: starts earlier, ends before next start
-                if (end_b < start_a) {} // no overlap, do nothing here, insert to list below
-                // Case B: starts earlier, ends earlier
-                else if (end_b < end_a)
-                {
-                    // stretch start_a back to start_b
-                    elist[i].duration += start_a - start_b;
-                    elist[i].radio_time = event->radio_time;
-                    resort_sched();
-                    return true;
-                }
-                // Case C: starts earlier, ends later
-                else
-                {
-                    // replace with the new event
-                    elist[i] = *event;
-                    resort_sched();
-                    return true;
-                }
-            }
-            else if (start_b < end_a) // but start_b >= start_a
-            {
-                // Case D: starts later, ends earlier
-                if (end_b < end_a)
-                {
-                    // full overlap, no need to re-add
-                    return true;
-                }
-                // Case E: starts later, ends later
-                else
-                {
-                    // stretch out the end of the event in elist
-                    elist[i].duration += end_b - end_a;
-                    return true;
-                }
-            }
-            // Case F: start_b >= end_a, so no overlap
-        }
+        uint32_t parent = (i - 1) >> 1;
+        if (!time_before(aux_events[i].radio_time, aux_events[parent].radio_time))
+            break;
+        heap_swap(i, parent);
+        i = parent;
+    }
+}
 
-        // if we're here, its a distinct event that needs to be added
-        // no more space
-        if (*num_events == max_events)
-            return false;
+static void sift_down(uint32_t i)
+{
+    while (1)
+    {
+        uint32_t l = 2*i + 1;
+        uint32_t r = l + 1;
+        uint32_t smallest = i;
+
+        if (l < num_aux_events &&
+                time_before(aux_events[l].radio_time, aux_events[smallest].radio_time))
+            smallest = l;
+        if (r < num_aux_events &&
+                time_before(aux_events[r].radio_time, aux_events[smallest].radio_time))
+            smallest = r;
+        if (smallest == i)
+            break;
+        heap_swap(i, smallest);
+        i = smallest;
+    }
+}
 
-        if (elist[i].radio_time - event->radio_time < 0x80000000)
-        {
-            // we found a spot to insert
-            uint32_t num_to_move = *num_events - i;
+static void heap_remove(uint32_t i)
+{
+    num_aux_events--;
+    if (i == num_aux_events)
+        return;
+    aux_events[i] = aux_events[num_aux_events];
+    sift_down(i);
+    sift_up(i);
+}
 
-            // make space and insert
-            memmove(elist + i + 1, elist + i, sizeof(struct AuxSchedInfo) * num_to_move);
-            elist[i] = *event;
-            *num_events += 1;
+// do the listening windows of a and b overlap (or touch)?
+static bool events_overlap(const struct AuxSchedInfo *a, const struct AuxSchedInfo *b)
+{
+    uint32_t start_a, start_b, end_a, end_b, offset;
 
-            return true;
-        }
-    }
+    // offset calculation to simplify handling of wraparound
+    offset = time_before(b->radio_time, a->radio_time) ? b->radio_time : a->radio_time;
+    start_a = a->radio_time - offset;
+    start_b = b->radio_time - offset;
+    end_a = start_a + a->duration;
+    end_b = start_b + b->duration;
 
-    // if we're here, its a distinct event that needs to be added
-    // no more space
-    if (*num_events == max_events)
-        return false;
+    return start_b <= end_a && start_a <= end_b;
+}
 
-    // insert at the end
-    elist[*num_events] = *event;
-    *num_events += 1;
-    return true;
+// stretch a to cover the union of a and b (they must overlap)
+static void events_merge(struct AuxSchedInfo *a, const struct AuxSchedInfo *b)
+{
+    uint32_t end_a = a->radio_time + a->duration;
+    uint32_t end_b = b->radio_time + b->duration;
+
+    if (time_before(b->radio_time, a->radio_time))
+        a->radio_time = b->radio_time;
+    if (time_before(end_a, end_b))
+        end_a = end_b;
+    a->duration = end_a - a->radio_time;
 }
 
-static void sched_list_pop(struct AuxSchedInfo *elist, uint32_t *num_events, uint32_t index)
+static bool insert_event(const struct AuxSchedInfo *event)
 {
-    if (index >= *num_events)
-        return;
+    struct AuxSchedInfo e = *event;
+    uint32_t i;
+
+    // Absorb every overlapping event on the same channel and PHY, wherever
+    // it sits relative to events on other channels. Merging may make the
+    // window overlap further events, so keep scanning until none are left.
+    i = 0;
+    while (i < num_aux_events)
+    {
+        struct AuxSchedInfo *o = aux_events + i;
+        if (o->chan == e.chan && o->phy == e.phy && o->aa == e.aa && events_overlap(o, &e))
+        {
+            events_merge(&e, o);
+            heap_remove(i);
+            i = 0;
+        }
+        else
+            i++;
+    }
 
-    memmove(elist + index, elist + index + 1,
-            sizeof(struct AuxSchedInfo) * (*num_events - index - 1));
+    // no more space
+    if (num_aux_events == AUX_SCHED_CAPACITY)
+    {
+        atomic_fetch_add(&g_perf.auxSchedMisses, 1);
+        return false;
+    }
 
-    *num_events -= 1;
+    aux_events[num_aux_events] = e;
+    sift_up(num_aux_events++);
+    return true;
 }
 
 bool AuxAdvScheduler_insert(uint8_t chan, PHY_Mode phy, uint32_t radio_time, uint32_t duration)
 {
     struct AuxSchedInfo e;
+
     e.chan = chan;
     e.phy = phy;
     e.radio_time = radio_time;
     e.duration = duration;
+    e.aa = ADV_AA;
+    e.crcInit = ADV_CRCI;
+
+    return insert_event(&e);
+}
+
+// Started events form a subtree at the root of the heap, since children
+// never start before their parents. Only that subtree needs to be visited.
+static int32_t find_ended(uint32_t radio_time)
+{
+    uint32_t stack[AUX_SCHED_CAPACITY];
+    uint32_t sp = 0;
+
+    if (num_aux_events && event_started(aux_events, radio_time))
+        stack[sp++] = 0;
 
-    return insert_event_sorted(&e, aux_events, &num_aux_events, MAX_AUX_EVENTS);
+    while (sp)
+    {
+        uint32_t i = stack[--sp];
+        if (event_ended(aux_events + i, radio_time))
+            return i;
+        for (uint32_t c = 2*i + 1; c <= 2*i + 2 && c < num_aux_events; c++)
+        {
+            if (event_started(aux_events + c, radio_time))
+                stack[sp++] = c;
+        }
+    }
+
+    return -1;
 }
 
 static void sched_clear_past(uint32_t cur_radio_time)
 {
-    for (int i = 0; i < num_aux_events; i++)
+    int32_t i;
+
+    while ((i = find_ended(cur_radio_time)) >= 0)
+        heap_remove(i);
+}
+
+static const uint16_t scaPpmTable[8] = {500, 250, 150, 100, 75, 50, 30, 20};
+
+bool AuxAdvScheduler_addPeriodic(const uint8_t *syncInfo, PHY_Mode phy, uint32_t pdu_time)
+{
+    struct PeriodicTrain *t = NULL;
+    uint16_t offsetField, interval;
+    uint32_t offsetUs, aa;
+    uint64_t chanMap = 0;
+    uint32_t i;
+
+    // SyncInfo: offset (13 bits), offset units, offset adjust, RFU; interval;
+    // ChM (37 bits) and SCA (3 bits); AA; CRCInit; paEventCounter
+    offsetField = syncInfo[0] | (syncInfo[1] << 8);
+    interval = syncInfo[2] | (syncInfo[3] << 8);
+    memcpy(&chanMap, syncInfo + 4, 5);
+    memcpy(&aa, syncInfo + 9, 4);
+
+    // offset of zero means the sync packet is too far away to describe
+    if ((offsetField & 0x1FFF) == 0 || interval < 6)
+        return false;
+    if ((chanMap & 0x1FFFFFFFFFULL) == 0)
+        return false;
+
+    offsetUs = (offsetField & 0x1FFF) * ((offsetField & 0x2000) ? 300 : 30);
+    if (offsetField & 0x4000)
+        offsetUs += 2457600;
+
+    // resync an existing train, or take a free slot
+    for (i = 0; i < MAX_PERIODIC_TRAINS; i++)
     {
-        struct AuxSchedInfo *e = aux_events + i;
-        uint32_t etime = e->radio_time + e->duration;
-        if (etime - cur_radio_time >= 0x80000000) {
-            sched_list_pop(aux_events, &num_aux_events, i);
-            i--; // deal with list shift
+        if (trains[i].active && trains[i].aa == aa)
+        {
+            t = trains + i;
+            break;
         }
+        if (!trains[i].active && !t)
+            t = trains + i;
+    }
+    if (!t)
+    {
+        atomic_fetch_add(&g_perf.auxSchedMisses, 1);
+        return false;
+    }
+
+    csa2_initContext(&t->hop, aa, chanMap & 0x1FFFFFFFFFULL);
+    t->aa = aa;
+    t->crcInit = syncInfo[13] | (syncInfo[14] << 8) | (syncInfo[15] << 16);
+    t->phy = phy;
+    t->scaPpm = scaPpmTable[syncInfo[8] >> 5];
+    t->eventCounter = syncInfo[16] | (syncInfo[17] << 8);
+    t->missed = 0;
+    t->interval = interval * 5000; // 1.25 ms units, 4 MHz radio clock
+    t->anchor = pdu_time;
+    t->eventTime = pdu_time + offsetUs*4;
+    t->queued = false;
+    t->active = true;
+
+    return true;
+}
+
+void AuxAdvScheduler_periodicRecv(uint32_t aa, uint32_t pdu_time)
+{
+    uint32_t i;
+
+    for (i = 0; i < MAX_PERIODIC_TRAINS; i++)
+    {
+        struct PeriodicTrain *t = trains + i;
+        if (!t->active || t->aa != aa)
+            continue;
+
+        // packet belongs to the event in progress, re-anchor to its actual time
+        // this absorbs clock drift between us and the advertiser
+        if (t->queued)
+        {
+            t->anchor = pdu_time;
+            t->eventTime = pdu_time + t->interval;
+            t->eventCounter++;
+            t->missed = 0;
+            t->queued = false;
+        }
+        break;
+    }
+}
+
+// uncertainty in event timing grows with time since last anchor
+static uint32_t train_widening(const struct PeriodicTrain *t)
+{
+    uint64_t elapsed = t->eventTime - t->anchor;
+    return (uint32_t)((elapsed * (t->scaPpm + LOCAL_SCA_PPM)) / 1000000) + PERIODIC_MARGIN_TICKS;
+}
+
+// advance trains past missed events and queue each train's next event
+static void sched_periodic(uint32_t radio_time)
+{
+    uint32_t i;
+
+    for (i = 0; i < MAX_PERIODIC_TRAINS; i++)
+    {
+        struct PeriodicTrain *t = trains + i;
+        struct AuxSchedInfo e;
+        uint32_t widening;
+
+        if (!t->active)
+            continue;
+
+        // event window passed without a packet
+        widening = train_widening(t);
+        while (t->eventTime + widening - radio_time >= 0x80000000)
+        {
+            t->eventTime += t->interval;
+            t->eventCounter++;
+            t->queued = false;
+            if (++t->missed > PERIODIC_MAX_MISSES)
+            {
+                t->active = false;
+                break;
+            }
+            widening = train_widening(t);
+        }
+
+        if (!t->active || t->queued)
+            continue;
+
+        e.chan = csa2_contextChannel(&t->hop, t->eventCounter);
+        e.phy = t->phy;
+        e.radio_time = t->eventTime - widening;
+        e.duration = widening * 2;
+        e.aa = t->aa;
+        e.crcInit = t->crcInit;
+        t->queued = insert_event(&e);
     }
 }
 
 // return value is the radio time until which the returned chan and phy remain valid
 // chan 0xFF means nothing scheduled right now
-uint32_t AuxAdvScheduler_next(uint32_t radio_time, uint8_t *chan, PHY_Mode *phy)
+uint32_t AuxAdvScheduler_next(uint32_t radio_time, uint8_t *chan, PHY_Mode *phy,
+        uint32_t *aa, uint32_t *crcInit)
 {
-    int32_t time_to_soonest_aux = 0x7FFFFFFF;
+    uint32_t stack[AUX_SCHED_CAPACITY];
+    uint32_t sp = 0;
+    uint32_t event_to_use, etime, next_start;
+    bool have_next = false;
 
     // clean up first
     sched_clear_past(radio_time);
+    sched_periodic(radio_time);
 
     // priority is: (non-periodic) aux, then regular advertising (0xFF do whatever)
-    // for overlapping events, use the most recently started one
-    if (num_aux_events)
-        time_to_soonest_aux = (int32_t)(aux_events[0].radio_time - radio_time);
-
-    if (time_to_soonest_aux <= 0)
+    if (!num_aux_events || !event_started(aux_events, radio_time))
     {
-        uint32_t event_to_use = 0;
+        // no aux happening, soonest one is at the root
+        *chan = 0xFF;
+        *phy = PHY_1M;
+        *aa = ADV_AA;
+        *crcInit = ADV_CRCI;
+        if (num_aux_events)
+            return aux_events[0].radio_time;
+        return radio_time + 0x7FFFFFFF;
+    }
 
-        // check if there are any newer ongoing overlapping events
-        for (uint32_t i = 1; i < num_aux_events; i++)
+    // for overlapping events, use the most recently started one, and find
+    // the soonest start among those still pending
+    event_to_use = 0;
+    next_start = 0;
+    stack[sp++] = 0;
+    while (sp)
+    {
+        uint32_t i = stack[--sp];
+        if (event_started(aux_events + i, radio_time))
         {
-            if ((int32_t)(aux_events[i].radio_time - radio_time) <= 0)
+            if (!time_before(aux_events[i].radio_time, aux_events[event_to_use].radio_time))
                 event_to_use = i;
-            else
-                break;
+            for (uint32_t c = 2*i + 1; c <= 2*i + 2 && c < num_aux_events; c++)
+                stack[sp++] = c;
         }
-
-        // check if next event starts sooner than current event ends
-        uint32_t etime = aux_events[event_to_use].radio_time +
-            aux_events[event_to_use].duration;
-        if (num_aux_events > event_to_use + 1)
+        else if (!have_next || time_before(aux_events[i].radio_time, next_start))
         {
-            uint32_t next_start = aux_events[event_to_use + 1].radio_time;
-            int32_t d = (int32_t)(next_start - etime);
-            if (d < 0)
-                etime = next_start;
+            next_start = aux_events[i].radio_time;
+            have_next = true;
         }
-
-        *chan = aux_events[event_to_use].chan;
-        *phy = aux_events[event_to_use].phy;
-        return etime;
     }
 
-    // no aux happening
-    *chan = 0xFF;
-    *phy = PHY_1M;
-    return radio_time + time_to_soonest_aux;
+    // check if next event starts sooner than current event ends
+    etime = aux_events[event_to_use].radio_time + aux_events[event_to_use].duration;
+    if (have_next && time_before(next_start, etime))
+        etime = next_start;
+
+    *chan = aux_events[event_to_use].chan;
+    *phy = aux_events[event_to_use].phy;
+    *aa = aux_events[event_to_use].aa;
+    *crcInit = aux_events[event_to_use].crcInit;
+    return etime;
 }
 
 void AuxAdvScheduler_reset(void)
 {
     num_aux_events = 0;
-    memset(aux_events, 0, sizeof(struct AuxSchedInfo) * MAX_AUX_EVENTS);
+    memset(aux_events, 0, sizeof(aux_events));
+    memset(trains, 0, sizeof(trains));
 }
@@ -13,7 +13,17 @@
 
 bool AuxAdvScheduler_insert(uint8_t chan, PHY_Mode phy,
         uint32_t radio_time, uint32_t duration);
-uint32_t AuxAdvScheduler_next(uint32_t radio_time, uint8_t *chan, PHY_Mode *phy);
+
+// start or resync following a periodic advertising train
+// syncInfo is the 18 byte SyncInfo field of the AUX_ADV_IND received at pdu_time
+bool AuxAdvScheduler_addPeriodic(const uint8_t *syncInfo, PHY_Mode phy, uint32_t pdu_time);
+
+// AUX_SYNC_IND received on a train's access address, used for drift tracking
+void AuxAdvScheduler_periodicRecv(uint32_t aa, uint32_t pdu_time);
+
+// aa and crcInit are those of the train for periodic events, else advertising ones
+uint32_t AuxAdvScheduler_next(uint32_t radio_time, uint8_t *chan, PHY_Mode *phy,
+        uint32_t *aa, uint32_t *crcInit);
 void AuxAdvScheduler_reset(void);
 
 #endif
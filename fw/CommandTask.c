@@ -21,6 +21,13 @@
 #include <TXQueue.h>
 #include <debug.h>
 #include <measurements.h>
+#include <perf_counters.h>
+#include <adv_dedup.h>
+#include <mac_list.h>
+#include <rpa_resolver.h>
+#include <aes_bench.h>
+#include <DelayHopTrigger.h>
+#include <DelayStopTrigger.h>
 
 #include <ti/sysbios/BIOS.h>
 #include <ti/sysbios/knl/Task.h>
@@ -68,6 +75,7 @@ static void commandTaskFunction(UArg arg0, UArg arg1)
          * second byte is opcode
          */
         if (ret < 2) continue;
+        atomic_fetch_add(&g_perf.commands, 1);
 
         switch (msgBuf[1])
         {
@@ -148,10 +156,11 @@ static void commandTaskFunction(UArg arg0, UArg arg1)
             break;
         }
         case COMMAND_SETIRK:
-            if (ret == 18)
-                setRpaFilt(true, msgBuf + 2); // filter to supplied IRK
+            // one or more 16 byte IRKs, up to RPA_MAX_IRKS
+            if (ret >= 18 && (ret - 2) % 16 == 0 && (ret - 2) / 16 <= RPA_MAX_IRKS)
+                setRpaFilt(true, msgBuf + 2, (ret - 2) / 16); // filter to supplied IRKs
             else
-                setRpaFilt(false, NULL); // disable RPA filter
+                setRpaFilt(false, NULL, 0); // disable RPA filter
             break;
         case COMMAND_INSTAHOP:
             if (ret != 3) continue;
@@ -214,6 +223,98 @@ static void commandTaskFunction(UArg arg0, UArg arg1)
             if (ret != 3) continue;
             RadioWrapper_setTxPower((int8_t)msgBuf[2]);
             break;
+        case COMMAND_FRAMING:
+            // 0 for base64+CRLF, 1 for COBS+CRC16
+            if (ret != 3) continue;
+            if (msgBuf[2] > 1) continue;
+            messenger_set_binary(msgBuf[2] ? true : false);
+            break;
+        case COMMAND_TXBATCH_STATS:
+            if (ret != 2) continue;
+            reportTxBatchStats();
+            break;
+        case COMMAND_COUNTERS:
+            if (ret != 2) continue;
+            reportPerfCounters();
+            break;
+        case COMMAND_SNAPLEN:
+            // 1 byte PDU type (SNAPLEN_DATA for data PDUs, SNAPLEN_ALL for all)
+            // 1 byte snaplen (0 to disable truncation)
+            if (ret != 4) continue;
+            if (msgBuf[2] >= SNAPLEN_NUM_TYPES && msgBuf[2] != SNAPLEN_ALL) continue;
+            if (msgBuf[3] == 1) continue; // must include whole 2 byte header
+            setSnapLen(msgBuf[2], msgBuf[3]);
+            break;
+        case COMMAND_DEDUP:
+        {
+            // 2 byte dedup window in ms (0 to disable)
+            if (ret != 4) continue;
+            uint16_t windowMs;
+            memcpy(&windowMs, msgBuf + 2, 2);
+            adv_dedup_set_window(windowMs);
+            break;
+        }
+        case COMMAND_MACLIST_CLEAR:
+            if (ret != 2) continue;
+            setMacListMode(MACLIST_OFF);
+            mac_list_clear();
+            // tell the host how many MACs fit
+            reportMeasMacList(0, mac_list_capacity(), 0);
+            break;
+        case COMMAND_MACLIST_ADD:
+        {
+            // one or more 6 byte MACs, MACs beyond list capacity are rejected
+            if (ret < 8 || (ret - 2) % 6) continue;
+            int i;
+            uint16_t rejected = 0;
+            for (i = 2; i < ret; i += 6)
+            {
+                if (!mac_list_add(msgBuf + i))
+                    rejected++;
+            }
+            if (rejected)
+                reportMeasMacList(mac_list_count(), mac_list_capacity(), rejected);
+            break;
+        }
+        case COMMAND_MACLIST_MODE:
+            if (ret != 3) continue;
+            if (msgBuf[2] > MACLIST_DENY) continue;
+            setMacListMode(msgBuf[2]);
+            break;
+        case COMMAND_AES_BENCH:
+        {
+            // 2 byte block count
+            if (ret != 4) continue;
+            uint16_t blocks;
+            memcpy(&blocks, msgBuf + 2, 2);
+            aes_bench_run(blocks);
+            break;
+        }
+        case COMMAND_HOPLAT:
+        {
+            // 1 byte flag, non-zero to clear histogram after reporting
+            if (ret != 3) continue;
+            uint32_t hist[HOP_LAT_BUCKETS];
+            RadioWrapper_getHopLatency(hist);
+            reportMeasHopLatency(HOP_LAT_BUCKET_US, hist, HOP_LAT_BUCKETS);
+            if (msgBuf[2])
+                RadioWrapper_resetHopLatency();
+            break;
+        }
+        case COMMAND_MULTICONN:
+            if (ret != 3) continue;
+            setMultiConn(msgBuf[2] ? true : false);
+            break;
+        case COMMAND_EXT_TS:
+            if (ret != 3) continue;
+            setExtTimestamps(msgBuf[2] ? true : false);
+            break;
+        case COMMAND_TRIG_JITTER:
+            // report scheduled vs. actual time of each timed hop and stop
+            if (ret != 3) continue;
+            DelayHopTrigger_setJitterReport(msgBuf[2] ? true : false);
+            DelayStopTrigger_setJitterReport(msgBuf[2] ? true : false);
+            break;
         default:
             break;
         }
@@ -34,5 +34,18 @@ void CommandTask_init(void);
 #define COMMAND_ADV_EXT         0x25
 #define COMMAND_CRC_VALID       0x26
 #define COMMAND_TX_POWER        0x27
+#define COMMAND_FRAMING         0x28
+#define COMMAND_TXBATCH_STATS   0x29
+#define COMMAND_COUNTERS        0x2A
+#define COMMAND_SNAPLEN         0x2B
+#define COMMAND_DEDUP           0x2C
+#define COMMAND_MACLIST_CLEAR   0x2D
+#define COMMAND_MACLIST_ADD     0x2E
+#define COMMAND_MACLIST_MODE    0x2F
+#define COMMAND_AES_BENCH       0x30
+#define COMMAND_HOPLAT          0x31
+#define COMMAND_MULTICONN       0x32
+#define COMMAND_EXT_TS          0x33
+#define COMMAND_TRIG_JITTER     0x34
 
 #endif /* COMMANDTASK_H */
@@ -17,13 +17,20 @@
 // My includes
 #include <DelayHopTrigger.h>
 #include <RadioWrapper.h>
+#include "measurements.h"
 
+// The hop is normally triggered by a radio timer compare event, which fires at
+// the exact radio time. The clock is only a fallback for when no compare channel
+// is free, and its 10 us ticks add jitter.
 static ClockP_Handle clk = NULL;
+static int ratChan = -1;
 
 static volatile bool trig_pending = false;
 static uint32_t target_ticks = 0;
+static volatile bool jitterReport = false;
 
 static void delay_tick(uintptr_t);
+static void rat_fire(uint32_t);
 
 void DelayHopTrigger_init()
 {
@@ -36,34 +43,84 @@ void DelayHopTrigger_init()
         while(1);
 }
 
+static void fire(uint32_t scheduled)
+{
+    trig_pending = false;
+    RadioWrapper_trigAdv3();
+    if (jitterReport)
+        reportMeasTrigJitter(TRIG_HOP, scheduled, RF_getCurrentTime());
+}
+
+static void arm()
+{
+    uint32_t ticks;
+
+    ratChan = RadioWrapper_ratCompare(target_ticks, rat_fire);
+    if (ratChan >= 0)
+        return;
+
+    ticks = target_ticks - RF_getCurrentTime();
+    if (ticks >= 0x80000000 || (ticks >> 2) < Clock_tickPeriod_D)
+    {
+        fire(target_ticks);
+        return;
+    }
+
+    ClockP_setTimeout(clk, (ticks >> 2) / Clock_tickPeriod_D);
+    ClockP_start(clk);
+}
+
+static void disarm()
+{
+    if (ratChan >= 0) {
+        RadioWrapper_ratCancel(ratChan);
+        ratChan = -1;
+    } else {
+        ClockP_stop(clk);
+    }
+}
+
 void DelayHopTrigger_trig(uint32_t delay_us)
 {
     if (delay_us == 0)
     {
         RadioWrapper_trigAdv3();
     } else {
-        ClockP_setTimeout(clk, delay_us / Clock_tickPeriod_D);
-        trig_pending = true;
-        target_ticks = RF_getCurrentTime() + delay_us*4;
-        ClockP_start(clk);
+        DelayHopTrigger_trigAt(RF_getCurrentTime() + delay_us*4);
     }
 }
 
-void DelayHopTrigger_postpone(uint32_t delay_us)
+void DelayHopTrigger_trigAt(uint32_t radio_ticks)
 {
-    uint32_t new_delay_ticks;
+    if (trig_pending)
+        disarm();
+    trig_pending = true;
+    target_ticks = radio_ticks;
+    arm();
+}
 
+void DelayHopTrigger_postpone(uint32_t delay_us)
+{
     if (!trig_pending)
         return;
 
-    ClockP_stop(clk);
-    new_delay_ticks = target_ticks - RF_getCurrentTime() + delay_us*4;
-    ClockP_setTimeout(clk, (new_delay_ticks >> 2) / Clock_tickPeriod_D);
-    ClockP_start(clk);
+    disarm();
+    target_ticks += delay_us*4;
+    arm();
+}
+
+void DelayHopTrigger_setJitterReport(bool enable)
+{
+    jitterReport = enable;
+}
+
+static void rat_fire(uint32_t compareTime)
+{
+    ratChan = -1;
+    fire(compareTime);
 }
 
 static void delay_tick(uintptr_t)
 {
-    trig_pending = false;
-    RadioWrapper_trigAdv3();
+    fire(target_ticks);
 }
@@ -8,9 +8,14 @@
 #define DELAYHOPTRIGGER_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 void DelayHopTrigger_init(void);
 void DelayHopTrigger_trig(uint32_t delay_us);
+void DelayHopTrigger_trigAt(uint32_t radio_ticks);
 void DelayHopTrigger_postpone(uint32_t delay_us);
 
+// report scheduled and actual time of every hop
+void DelayHopTrigger_setJitterReport(bool enable);
+
 #endif
@@ -17,13 +17,18 @@
 // My includes
 #include <DelayStopTrigger.h>
 #include <RadioWrapper.h>
+#include "measurements.h"
 
+// radio timer compare for precise stops, clock as fallback (see DelayHopTrigger)
 static ClockP_Handle clk = NULL;
+static int ratChan = -1;
 
 static volatile bool trig_pending = false;
 static uint32_t target_ticks = 0;
+static volatile bool jitterReport = false;
 
 static void delay_tick(uintptr_t);
+static void rat_fire(uint32_t);
 
 void DelayStopTrigger_init()
 {
@@ -36,31 +41,77 @@ void DelayStopTrigger_init()
         while(1);
 }
 
+static void fire(uint32_t scheduled)
+{
+    trig_pending = false;
+    RadioWrapper_stop();
+    if (jitterReport)
+        reportMeasTrigJitter(TRIG_STOP, scheduled, RF_getCurrentTime());
+}
+
+static void disarm()
+{
+    if (ratChan >= 0) {
+        RadioWrapper_ratCancel(ratChan);
+        ratChan = -1;
+    } else {
+        ClockP_stop(clk);
+    }
+    trig_pending = false;
+}
+
 void DelayStopTrigger_trig(uint32_t delay_us)
 {
     if (delay_us == 0)
     {
-        if (trig_pending) {
-            ClockP_stop(clk);
-            trig_pending = false;
-        }
+        if (trig_pending)
+            disarm();
         RadioWrapper_stop();
     } else {
-        // never allow delaying a stop, only allow making it sooner
-        uint32_t new_target_ticks = RF_getCurrentTime() + (delay_us*4);
-        if (trig_pending && (target_ticks - new_target_ticks > 0x80000000))
-            return;
+        DelayStopTrigger_trigAt(RF_getCurrentTime() + (delay_us*4));
+    }
+}
 
-        ClockP_stop(clk);
-        ClockP_setTimeout(clk, delay_us / Clock_tickPeriod_D);
-        trig_pending = true;
-        target_ticks = new_target_ticks;
-        ClockP_start(clk);
+void DelayStopTrigger_trigAt(uint32_t radio_ticks)
+{
+    uint32_t ticks;
+
+    // never allow delaying a stop, only allow making it sooner
+    if (trig_pending && (target_ticks - radio_ticks > 0x80000000))
+        return;
+
+    if (trig_pending)
+        disarm();
+    trig_pending = true;
+    target_ticks = radio_ticks;
+
+    ratChan = RadioWrapper_ratCompare(target_ticks, rat_fire);
+    if (ratChan >= 0)
+        return;
+
+    ticks = target_ticks - RF_getCurrentTime();
+    if (ticks >= 0x80000000 || (ticks >> 2) < Clock_tickPeriod_D)
+    {
+        fire(target_ticks);
+        return;
     }
+
+    ClockP_setTimeout(clk, (ticks >> 2) / Clock_tickPeriod_D);
+    ClockP_start(clk);
+}
+
+void DelayStopTrigger_setJitterReport(bool enable)
+{
+    jitterReport = enable;
+}
+
+static void rat_fire(uint32_t compareTime)
+{
+    ratChan = -1;
+    fire(compareTime);
 }
 
 static void delay_tick(uintptr_t)
 {
-    trig_pending = false;
-    RadioWrapper_stop();
+    fire(target_ticks);
 }
@@ -8,8 +8,13 @@
 #define DELAYSTOPTRIGGER_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 void DelayStopTrigger_init(void);
 void DelayStopTrigger_trig(uint32_t delay_us);
+void DelayStopTrigger_trigAt(uint32_t radio_ticks);
+
+// report scheduled and actual time of every stop
+void DelayStopTrigger_setJitterReport(bool enable);
 
 #endif
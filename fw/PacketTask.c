@@ -17,11 +17,16 @@
 #include <RadioWrapper.h>
 #include <messenger.h>
 #include <rpa_resolver.h>
+#include <measurements.h>
+#include <adv_dedup.h>
+#include <mac_list.h>
+#include <RatTime.h>
 
 #include <ti/sysbios/BIOS.h>
 #include <ti/sysbios/knl/Task.h>
 #include <ti/sysbios/knl/Semaphore.h>
 #include <ti/sysbios/knl/Event.h>
+#include <ti/sysbios/knl/Clock.h>
 
 /* Drivers */
 #include <ti/drivers/GPIO.h>
@@ -29,6 +34,7 @@
 
 /* Board Header files */
 #include "ti_drivers_config.h"
+#include "ti_sysbios_config.h"
 
 /***** Defines *****/
 #define PACKET_TASK_STACK_SIZE 1024
@@ -36,6 +42,9 @@
 
 #define RX_ACTIVITY_LED CONFIG_LED_0
 
+// how often to report drop statistics (if any frames were lost)
+#define DROP_REPORT_TICKS (1000000 / Clock_tickPeriod_D)
+
 /***** Type declarations *****/
 
 
@@ -50,9 +59,13 @@ static int8_t minRssi = -128;
 static uint8_t targMac[6];
 static bool filterMacs = false;
 
-static uint8_t targIrk[16];
 static bool filterRpas = false;
 
+static uint8_t macListMode = MACLIST_OFF;
+
+// per PDU type capture length limits, 0 means unlimited
+static uint8_t snapLens[SNAPLEN_NUM_TYPES];
+
 /***** Prototypes *****/
 static void packetTaskFunction(UArg arg0, UArg arg1);
 static bool macFilterCheck(BLE_Frame *frame);
@@ -60,26 +73,61 @@ static bool macFilterCheck(BLE_Frame *frame);
 /* LED driver handle */
 static LED_Handle ledHandle;
 
-// size must be a power of 2
+// size must be a power of 2, makefile sets it per platform based on SRAM size
+#ifdef PACKET_QUEUE_SIZE
+#define JANKY_QUEUE_SIZE PACKET_QUEUE_SIZE
+#else
 #define JANKY_QUEUE_SIZE 8u
+#endif
 #define JANKY_QUEUE_MASK (JANKY_QUEUE_SIZE - 1)
 
+#if (JANKY_QUEUE_SIZE & JANKY_QUEUE_MASK) != 0
+#error "JANKY_QUEUE_SIZE must be a power of 2"
+#endif
+
 // 255+2=257 is the most we need, but use 260 for better alignment/performance
 #define PACKET_SIZE 260
 
-static uint8_t packet_buf[PACKET_SIZE*JANKY_QUEUE_SIZE];
+// space reserved before each body for the largest message header (BLEFRAME_EXT)
+#define MSG_HEADROOM 17
+#define SLOT_SIZE (MSG_HEADROOM + PACKET_SIZE)
+
+// room for several worst case encoded messages per UART write
+#define TX_BATCH_SIZE (MESSENGER_ENC_MAX * 4)
+
+static uint8_t packet_buf[SLOT_SIZE*JANKY_QUEUE_SIZE];
 static BLE_Frame s_frames[JANKY_QUEUE_SIZE];
+static uint16_t s_capLens[JANKY_QUEUE_SIZE]; // bytes of pData actually stored
 
 static volatile atomic_uint queue_head; // insert here
 static volatile atomic_uint queue_tail; // take out item from here
 
+static uint8_t tx_buf[TX_BATCH_SIZE];
+
+// UART batching statistics, reported to host on request
+static uint32_t txBatches = 0;
+static uint32_t txBatchFrames = 0;
+static uint16_t txBatchMax = 0;
+
+// frame accounting, updated from radio callback and task contexts
+static volatile atomic_uint framesQueued;
+static volatile atomic_uint dropQueueFull;
+static volatile atomic_uint dropOversize;
+static volatile atomic_uint dropFiltered;
+static uint32_t lastReportedDrops = 0;
+
+// send full resolution 64 bit timestamps, in BLEFRAME_EXT and MARKER_EXT messages
+#define FRAME_HDR_VERSION 1
+static volatile bool extTimestamps = false;
+static uint32_t lastDropReportTicks = 0;
+
 /***** Function definitions *****/
 void PacketTask_init(void) {
     int i;
 
     /* initialize s_frames */
     for (i = 0; i < JANKY_QUEUE_SIZE; i++) {
-        s_frames[i].pData = packet_buf + PACKET_SIZE*i;
+        s_frames[i].pData = packet_buf + SLOT_SIZE*i + MSG_HEADROOM;
     }
 
     /* Open LED pins */
@@ -91,7 +139,11 @@ void PacketTask_init(void) {
         System_abort("Error initializing board 3.3V domain pins\n");
     }
 
-    packetAvailSem = Semaphore_create(0, NULL, NULL);
+    // binary semaphore, since each wakeup drains every queued frame
+    Semaphore_Params semParams;
+    Semaphore_Params_init(&semParams);
+    semParams.mode = Semaphore_Mode_BINARY;
+    packetAvailSem = Semaphore_create(0, &semParams, NULL);
 
     // Open UART
     messenger_init();
@@ -104,154 +156,274 @@ void PacketTask_init(void) {
     Task_construct(&packetTask, packetTaskFunction, &packetTaskParams, NULL);
 }
 
-static void sendPacket(BLE_Frame *frame)
+// encodes frame into dst_buf, returns encoded length
+// message header is written into the slot headroom preceding frame->pData,
+// so the body is encoded in place without being copied again
+// only the first cap_len bytes of the body are sent, frame->length is the original
+static unsigned encodePacket(BLE_Frame *frame, uint16_t cap_len, uint8_t *dst_buf)
 {
-    // static to avoid making stack huge
-    // this is not reentrant!
-    static uint8_t msg_buf[MESSAGE_MAX];
-    uint8_t *msg_ptr = msg_buf + 1;
+    uint8_t hdr[MSG_HEADROOM];
+    uint8_t *hdr_ptr = hdr + 1;
+    uint8_t *msg_buf;
+    unsigned hdr_len, body_len;
 
     // should never happen
     if (frame->length > PACKET_SIZE)
-        return;
+        return 0;
+
+    body_len = cap_len;
 
     // special case: debug prints
     if (frame->channel == MSGCHAN_DEBUG)
     {
         // Byte 0 is message type
-        *msg_ptr++ = MESSAGE_DEBUG;
+        *hdr_ptr++ = MESSAGE_DEBUG;
 
         // Bytes 1 and up are debug print string
-        memcpy(msg_ptr, frame->pData, frame->length);
-        msg_ptr += frame->length;
+    } else if (frame->channel == MSGCHAN_MARKER && extTimestamps) {
+        // byte 0 is message type, byte 1 is header version
+        *hdr_ptr++ = MESSAGE_MARKER_EXT;
+        *hdr_ptr++ = FRAME_HDR_VERSION;
+
+        // bytes 2-9 are extended radio timestamp (little endian, 0.25 us units)
+        uint64_t timestamp = RatTime_extend(frame->timestamp);
+        memcpy(hdr_ptr, &timestamp, sizeof(timestamp));
+        hdr_ptr += sizeof(timestamp);
+
+        // bytes 10+ are marker data
     } else if (frame->channel == MSGCHAN_MARKER) {
         // Byte 0 is message type
-        *msg_ptr++ = MESSAGE_MARKER;
+        *hdr_ptr++ = MESSAGE_MARKER;
 
         // bytes 1-4 are timestamp (little endian)
         uint32_t timestamp_us = frame->timestamp >> 2;
-        memcpy(msg_ptr, &timestamp_us, sizeof(timestamp_us));
-        msg_ptr += sizeof(timestamp_us);
+        memcpy(hdr_ptr, &timestamp_us, sizeof(timestamp_us));
+        hdr_ptr += sizeof(timestamp_us);
 
         // bytes 5+ are marker data
-        memcpy(msg_ptr, frame->pData, frame->length);
-        msg_ptr += frame->length;
     } else if (frame->channel == MSGCHAN_STATE) {
         // byte 0 is message type
-        *msg_ptr++ = MESSAGE_STATE;
+        *hdr_ptr++ = MESSAGE_STATE;
 
         // byte 1 is the new state
-        *msg_ptr++ = frame->pData[0];
+        body_len = 1;
     } else if (frame->channel == MSGCHAN_MEASURE) {
         // byte 0 is message type
-        *msg_ptr++ = MESSAGE_MEASURE;
+        *hdr_ptr++ = MESSAGE_MEASURE;
 
         // byte 1 is length
-        *msg_ptr++ = (uint8_t)frame->length;
+        *hdr_ptr++ = (uint8_t)frame->length;
 
         // bytes 2+ are message body
-        memcpy(msg_ptr, frame->pData, frame->length);
-        msg_ptr += frame->length;
     } else {
-        // byte 0 is message type
-        *msg_ptr++ = MESSAGE_BLEFRAME;
+        if (extTimestamps) {
+            // byte 0 is message type, byte 1 is header version
+            *hdr_ptr++ = MESSAGE_BLEFRAME_EXT;
+            *hdr_ptr++ = FRAME_HDR_VERSION;
+
+            // bytes 2-9 are extended radio timestamp (little endian, 0.25 us units)
+            // remaining fields are as below, shifted by 5 bytes
+            uint64_t timestamp = RatTime_extend(frame->timestamp);
+            memcpy(hdr_ptr, &timestamp, sizeof(timestamp));
+            hdr_ptr += sizeof(timestamp);
+        } else {
+            // byte 0 is message type
+            *hdr_ptr++ = MESSAGE_BLEFRAME;
 
-        // bytes 1-4 are timestamp (little endian)
-        uint32_t timestamp_us = frame->timestamp >> 2;
-        memcpy(msg_ptr, &timestamp_us, sizeof(timestamp_us));
-        msg_ptr += sizeof(timestamp_us);
+            // bytes 1-4 are timestamp (little endian)
+            uint32_t timestamp_us = frame->timestamp >> 2;
+            memcpy(hdr_ptr, &timestamp_us, sizeof(timestamp_us));
+            hdr_ptr += sizeof(timestamp_us);
+        }
 
-        // bytes 5-6 are length (little endian), MSBs are CRC and direction
+        // bytes 5-6 are original length (little endian), MSBs are CRC and direction
+        // bits 11-13 are the connection index when following several connections
+        // body may be shorter than this length if truncated by snaplen
         uint16_t len_dir = frame->length;
+        len_dir |= frame->connIdx << 11;
         len_dir |= frame->crcError << 14;
         len_dir |= frame->direction << 15;
-        memcpy(msg_ptr, &len_dir, sizeof(len_dir));
-        msg_ptr += sizeof(len_dir);
+        memcpy(hdr_ptr, &len_dir, sizeof(len_dir));
+        hdr_ptr += sizeof(len_dir);
 
         // bytes 7-8 are connEventCount
-        memcpy(msg_ptr, &frame->eventCtr, sizeof(frame->eventCtr));
-        msg_ptr += sizeof(frame->eventCtr);
+        memcpy(hdr_ptr, &frame->eventCtr, sizeof(frame->eventCtr));
+        hdr_ptr += sizeof(frame->eventCtr);
 
         // byte 9 is rssi
-        *msg_ptr++ = (uint8_t)frame->rssi;
+        *hdr_ptr++ = (uint8_t)frame->rssi;
 
         // byte 10 is channel and PHY
-        *msg_ptr++ = frame->channel | (frame->phy << 6);
+        *hdr_ptr++ = frame->channel | (frame->phy << 6);
 
         // bytes 11+ are message body
-        memcpy(msg_ptr, frame->pData, frame->length);
-        msg_ptr += frame->length;
     }
 
+    hdr_len = hdr_ptr - hdr;
+
     // first byte of b64 decoded data indicates number of 4 byte chunks
-    msg_buf[0] = (msg_ptr - msg_buf + 2) / 3;
+    hdr[0] = (hdr_len + body_len + 2) / 3;
+
+    msg_buf = frame->pData - hdr_len;
+    memcpy(msg_buf, hdr, hdr_len);
+
+    return messenger_encode(dst_buf, msg_buf, hdr_len + body_len);
+}
+
+static void reportDropStats()
+{
+    uint32_t drops;
 
-    messenger_send(msg_buf, msg_ptr - msg_buf);
+    // filtered frames are expected, so only report when frames were lost
+    drops = packetsDropped();
+    if (drops == lastReportedDrops)
+        return;
+    lastReportedDrops = drops;
+
+    reportMeasDrops(atomic_load(&framesQueued), atomic_load(&dropQueueFull),
+            atomic_load(&dropOversize), atomic_load(&dropFiltered));
 }
 
 static void packetTaskFunction(UArg arg0, UArg arg1)
 {
     while (1)
     {
+        unsigned tx_len = 0;
+        uint16_t batch_frames = 0;
+
+        // periodically report losses, even when idle
+        if (Clock_getTicks() - lastDropReportTicks >= DROP_REPORT_TICKS)
+        {
+            lastDropReportTicks = Clock_getTicks();
+            reportDropStats();
+        }
+
         // wait for a packet
-        Semaphore_pend(packetAvailSem, BIOS_WAIT_FOREVER);
+        if (!Semaphore_pend(packetAvailSem, DROP_REPORT_TICKS))
+            continue;
 
         // activate LED
         LED_write(ledHandle, 1);
 
-        // send packet
-        sendPacket(s_frames + (atomic_load(&queue_tail) & JANKY_QUEUE_MASK));
+        // encode every queued packet, writing to UART only when the batch fills
+        while (atomic_load(&queue_tail) != atomic_load(&queue_head))
+        {
+            if (tx_len + MESSENGER_ENC_MAX > sizeof(tx_buf))
+            {
+                messenger_write(tx_buf, tx_len);
+                tx_len = 0;
+            }
+
+            unsigned queue_tail_ = atomic_load(&queue_tail) & JANKY_QUEUE_MASK;
+            tx_len += encodePacket(s_frames + queue_tail_, s_capLens[queue_tail_],
+                    tx_buf + tx_len);
+            batch_frames++;
+
+            // frame is encoded, so its slot can be reused (wraparound is OK)
+            atomic_fetch_add(&queue_tail, 1);
+        }
+
+        if (tx_len)
+            messenger_write(tx_buf, tx_len);
 
         // deactivate LED
         LED_write(ledHandle, 0);
 
-        // we can now handle a new packet (wraparound is OK)
-        atomic_fetch_add(&queue_tail, 1);
+        if (batch_frames)
+        {
+            txBatches++;
+            txBatchFrames += batch_frames;
+            if (batch_frames > txBatchMax)
+                txBatchMax = batch_frames;
+        }
     }
 }
 
+void reportTxBatchStats(void)
+{
+    reportMeasTxBatch(txBatches, txBatchFrames, txBatchMax);
+}
+
+uint32_t packetsDropped(void)
+{
+    return atomic_load(&dropQueueFull) + atomic_load(&dropOversize);
+}
+
 void indicatePacket(BLE_Frame *frame)
 {
     int queue_check, queue_head_;
+    uint16_t cap_len = frame->length;
 
     // Frames with channel 40 and up are out of band messages (eg. debug prints)
     if (frame->channel < 40)
     {
-        // It only makes sense to filter advertisements
-        if (!inDataState())
+        // It only makes sense to filter advertisements, including those heard
+        // on advertising channels between connection events in DATA state
+        if (!inDataState() || frame->channel >= 37)
         {
             // RSSI filtering
             if (frame->rssi < minRssi)
+            {
+                atomic_fetch_add(&dropFiltered, 1);
                 return;
+            }
 
             // MAC filtering
             if (!macFilterCheck(frame))
+            {
+                atomic_fetch_add(&dropFiltered, 1);
                 return;
-        } else {
+            }
+        } else if (frame->connIdx == 0) {
             frame->direction = g_pkt_dir;
             frame->eventCtr = connEventCount;
         }
 
         // always process PDU regardless of queue state
-        if (!frame->crcError)
+        // secondary connections are tracked by the connection scheduler
+        if (!frame->crcError && frame->connIdx == 0)
             reactToPDU(frame);
+
+        // forward only the first copy of repeated advertisements within dedup window
+        // (only advertising channel frames are considered)
+        if (adv_dedup_check(frame))
+        {
+            atomic_fetch_add(&dropFiltered, 1);
+            return;
+        }
+
+        // truncate the copy we send to host if requested
+        uint8_t snap_len = (inDataState() && frame->channel < 37) ?
+            snapLens[SNAPLEN_DATA] : snapLens[frame->pData[0] & 0xF];
+        if (snap_len && snap_len < cap_len)
+            cap_len = snap_len;
     }
 
     if (frame->length > PACKET_SIZE)
+    {
+        atomic_fetch_add(&dropOversize, 1);
         return;
+    }
 
     // discard the packet if we're full
     queue_check = (atomic_load(&queue_head) - atomic_load(&queue_tail)) & JANKY_QUEUE_MASK;
-    if (queue_check == JANKY_QUEUE_MASK) return;
+    if (queue_check == JANKY_QUEUE_MASK)
+    {
+        atomic_fetch_add(&dropQueueFull, 1);
+        return;
+    }
+    atomic_fetch_add(&framesQueued, 1);
 
     // wraparound is safe due to our masking
     queue_head_ = atomic_fetch_add(&queue_head, 1) & JANKY_QUEUE_MASK;
 
-    memcpy(s_frames[queue_head_].pData, frame->pData, frame->length);
+    memcpy(s_frames[queue_head_].pData, frame->pData, cap_len);
+    s_capLens[queue_head_] = cap_len;
     s_frames[queue_head_].length = frame->length;
     s_frames[queue_head_].crcError = frame->crcError;
     s_frames[queue_head_].direction = frame->direction;
     s_frames[queue_head_].eventCtr = frame->eventCtr;
+    s_frames[queue_head_].connIdx = frame->connIdx;
     s_frames[queue_head_].rssi = frame->rssi;
     s_frames[queue_head_].timestamp = frame->timestamp;
     s_frames[queue_head_].channel = frame->channel;
@@ -259,26 +431,58 @@ void indicatePacket(BLE_Frame *frame)
     Semaphore_post(packetAvailSem);
 }
 
+void setExtTimestamps(bool enable)
+{
+    extTimestamps = enable;
+}
+
 void setMinRssi(int8_t rssi)
 {
     minRssi = rssi;
 }
 
-// RPA and MAC filters are mutually exclusive
+void setSnapLen(uint8_t pduType, uint8_t len)
+{
+    if (pduType == SNAPLEN_ALL)
+        memset(snapLens, len, sizeof(snapLens));
+    else if (pduType < SNAPLEN_NUM_TYPES)
+        snapLens[pduType] = len;
+}
+
+// RPA, MAC, and MAC list filters are mutually exclusive
 void setMacFilt(bool filt, uint8_t *mac)
 {
     if (mac != NULL)
         memcpy(targMac, mac, 6);
     filterMacs = filt;
     filterRpas = false;
+    macListMode = MACLIST_OFF;
 }
 
-void setRpaFilt(bool filt, void *irk)
+void setRpaFilt(bool filt, const void *irks, uint8_t numIrks)
 {
-    if (irk != NULL)
-        memcpy(targIrk, irk, 16);
+    uint8_t i;
+
+    if (irks != NULL)
+    {
+        filterRpas = false;
+        rpa_irks_clear();
+        for (i = 0; i < numIrks; i++)
+            rpa_irk_add((const uint8_t *)irks + 16*i);
+    }
     filterRpas = filt;
     filterMacs = false;
+    macListMode = MACLIST_OFF;
+}
+
+void setMacListMode(uint8_t mode)
+{
+    macListMode = mode;
+    if (mode != MACLIST_OFF)
+    {
+        filterMacs = false;
+        filterRpas = false;
+    }
 }
 
 bool macOk(uint8_t *mac, bool isRandom)
@@ -286,7 +490,11 @@ bool macOk(uint8_t *mac, bool isRandom)
     if (filterMacs)
         return memcmp(mac, targMac, 6) == 0;
     else if (filterRpas)
-        return isRandom && rpa_match(targIrk, mac);
+        return isRandom && rpa_resolve(mac) >= 0;
+    else if (macListMode == MACLIST_ALLOW)
+        return mac_list_contains(mac);
+    else if (macListMode == MACLIST_DENY)
+        return !mac_list_contains(mac);
     else
         return true;
 }
@@ -297,7 +505,7 @@ static bool macFilterCheck(BLE_Frame *frame)
     uint8_t *mac;
     bool isRandom;
 
-    if (!filterMacs && !filterRpas)
+    if (!filterMacs && !filterRpas && macListMode == MACLIST_OFF)
         return true;
 
     // make sure it has a header at least
@@ -16,22 +16,47 @@
 #define MSGCHAN_STATE   42
 #define MSGCHAN_MEASURE 43
 
+// snaplen table indices: 0-15 are advertising PDU types
+#define SNAPLEN_DATA        16
+#define SNAPLEN_NUM_TYPES   17
+#define SNAPLEN_ALL         0xFF
+
+// MAC list filter modes
+#define MACLIST_OFF         0
+#define MACLIST_ALLOW       1
+#define MACLIST_DENY        2
+
 /* Create the PacketTask and creates all TI-RTOS objects */
 void PacketTask_init(void);
 
 /* asynchronously blink LED and display packet over UART */
 void indicatePacket(BLE_Frame *frame);
 
+/* send 64 bit sub-microsecond frame timestamps instead of 32 bit microseconds */
+void setExtTimestamps(bool enable);
+
 /* set the minimum RSSI accepted by the packet filter */
 void setMinRssi(int8_t rssi);
 
+/* limit bytes of PDU (including header) sent to host for a PDU type, 0 for no limit */
+void setSnapLen(uint8_t pduType, uint8_t len);
+
 /* specify whether or not we want MAC filtering, and specify target MAC */
 void setMacFilt(bool filt, uint8_t *mac);
 
-/* specify whether or not we want RPA filtering, and specify target IRK */
-void setRpaFilt(bool filt, void *irk);
+/* specify whether or not we want RPA filtering, and specify target IRKs */
+void setRpaFilt(bool filt, const void *irks, uint8_t numIrks);
+
+/* filter by MACs loaded with mac_list_add, as an allowlist or denylist */
+void setMacListMode(uint8_t mode);
 
 /* check if specified MAC address is allowed by filter */
 bool macOk(uint8_t *mac, bool isRandom);
 
+/* report UART batch count, frames sent, and largest batch as a measurement */
+void reportTxBatchStats(void);
+
+/* number of frames lost due to a full queue or excessive length */
+uint32_t packetsDropped(void);
+
 #endif /* PACKETTASK_H */
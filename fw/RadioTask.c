@@ -5,7 +5,6 @@
  */
 
 /***** Includes *****/
-#include <stdlib.h>
 #include <stdbool.h>
 #include <xdc/std.h>
 #include <xdc/runtime/System.h>
@@ -17,12 +16,17 @@
 /* Drivers */
 #include <ti/drivers/rf/RF.h>
 
+#include "csa1.h"
 #include "csa2.h"
+#include "chan_ring.h"
+#include "drift_pll.h"
+#include "conn_sched.h"
 #include "adv_header_cache.h"
 #include "debug.h"
 #include "conf_queue.h"
 #include "TXQueue.h"
 #include "measurements.h"
+#include "perf_counters.h"
 
 #include <RadioTask.h>
 #include <RadioWrapper.h>
@@ -63,7 +67,6 @@ typedef enum
 static Task_Params radioTaskParams;
 Task_Struct radioTask; /* not static so you can see in ROV */
 static uint8_t radioTaskStack[RADIO_TASK_STACK_SIZE];
-static uint8_t mapping_table[37];
 
 static SnifferState snifferState = STATIC;
 static SnifferState sniffDoneState = STATIC;
@@ -74,6 +77,7 @@ static uint32_t statCRCI = 0x555555;
 
 static struct RadioConfig rconf;
 static uint32_t accessAddress = BLE_ADV_AA;
+static uint32_t listenAA = BLE_ADV_AA; // access address of the current aux/periodic listen
 static uint8_t curUnmapped;
 static uint8_t hopIncrement;
 static uint32_t crcInit;
@@ -89,8 +93,10 @@ static bool gotLegacy39;
 static bool gotAuxConnReq;
 static bool firstPacket;
 static uint32_t lastAdvTimestamp;
-static uint32_t anchorOffset[4];
-static uint32_t aoInd = 0;
+static int32_t anchorErr;  // anchor time minus expected, in current event
+static DriftPLL driftPll;
+static uint32_t aoLead = AO_TARG;
+static uint32_t dataListenTime; // when to be listening for the next primary event, or LISTEN_NOW
 static uint32_t sniffScanRspLen = 26;
 
 static uint32_t lastAnchorTicks;
@@ -99,6 +105,9 @@ static uint32_t itInd;
 
 static uint64_t chanMapTestMask;
 
+// lookahead ring of channels for upcoming connection events
+static ChanRing chanRing;
+
 // preloaded encrypted connection interval and WinOffset changes
 #define MAX_PARAM_PAIRS 4
 static uint32_t numParamPairs;
@@ -123,6 +132,10 @@ static bool validateCrc = true;
 // bit 0 is C->P, bit 1 is P->C
 static uint8_t moreData;
 
+// following secondary connections between primary connection events
+static bool multiConn = false;
+static ConnContext *secConn;
+
 static bool advHopEnabled = false;
 static bool auxAdvEnabled = false;
 
@@ -153,10 +166,20 @@ uint8_t g_pkt_dir = 0;
 // I've measured this latency vary between 240-300 us.
 #define HOP_TUNE_LISTEN_LATENCY 300
 
+// Time (in microseconds) to wrap up a connection event and issue the next
+// receive, so it reaches the radio before its absolute start time
+#define HOP_ISSUE_MARGIN 100
+
 // target offset before anchor point to start listing on next data channel
 // 0.5 ms @ 4 Mhz
 #define AO_TARG 2000
 
+// tightest offset used once central clock drift is tracked, covers hop latency
+#define AO_MIN ((HOP_TUNE_LISTEN_LATENCY + 50) * 4)
+
+// report clock drift estimate every this many connection events (power of 2)
+#define DRIFT_REPORT_EVENTS 256
+
 // be ready some microseconds before aux advertisement is received
 #define AUX_OFF_TARG_USEC 500
 
@@ -164,16 +187,32 @@ uint8_t g_pkt_dir = 0;
 // radio will get stuck if end time is in past
 #define LISTEN_TICKS_MIN 2000
 
+// gap activity must end this long before the primary connection's next hop,
+// so the next primary receive can still be issued ahead of its start time
+#define MULTI_GAP_GUARD ((HOP_TUNE_LISTEN_LATENCY + HOP_ISSUE_MARGIN) * 4)
+
+// assumed length of a primary connection event, for collision accounting
+#define MULTI_PRIMARY_EVENT 10000
+
+// receive start times further off than the longest connection interval are stale
+#define RX_START_MAX_TICKS (4000000 * 4)
+
+// dataListenTime value for starting the next primary receive immediately
+#define LISTEN_NOW 0
+
 /***** Prototypes *****/
 static void radioTaskFunction(UArg arg0, UArg arg1);
 static void computeMaps();
-static void computeMap1(uint64_t map);
+static void chanRingReset(void);
+static void chanRingFill(uint32_t maxNew);
 static void handleConnFinished(void);
 static void reactToDataPDU(const BLE_Frame *frame, bool transmit);
 static void reactToAdvExtPDU(const BLE_Frame *frame, uint8_t advLen);
 static void handleConnReq(PHY_Mode phy, uint32_t connTime, uint8_t *llData,
         bool isAuxReq);
 static void reactToTransmitted(dataQueue_t *pTXQ, uint32_t numEntries);
+static void serviceGap(void);
+static uint32_t rxStartTime(uint32_t listenTime);
 
 /***** Function definitions *****/
 void RadioTask_init(void)
@@ -185,16 +224,12 @@ void RadioTask_init(void)
     Task_construct(&radioTask, radioTaskFunction, &radioTaskParams, NULL);
 }
 
-static int _compare(const void *a, const void *b)
+static uint32_t median3(const uint32_t *arr)
 {
-    return *(int32_t *)a - *(int32_t *)b;
-}
-
-// not technically correct for even sized arrays but it doesn't matter here
-static uint32_t median(uint32_t *arr, size_t sz)
-{
-    qsort(arr, sz, sizeof(uint32_t), _compare);
-    return arr[sz >> 1];
+    uint32_t a = arr[0], b = arr[1], c = arr[2];
+    if (a > b) { uint32_t t = a; a = b; b = t; }
+    if (b > c) b = c;
+    return a > b ? a : b;
 }
 
 static void stateTransition(SnifferState newState)
@@ -214,6 +249,7 @@ static void stateTransition(SnifferState newState)
     frame.pData = &buf;
     frame.length = 1;
     frame.eventCtr = 0;
+    frame.connIdx = 0;
 
     // Does thread safe copying into queue
     indicatePacket(&frame);
@@ -222,10 +258,28 @@ static void stateTransition(SnifferState newState)
 // no side effects
 static inline uint8_t getCurrChan()
 {
+    uint8_t chan;
+
+    // O(1) when the lookahead ring covers the current event
+    if (chan_ring_lookup(&chanRing, connEventCount, &chan))
+        return chan;
+
     if (use_csa2)
         return csa2_computeChannel(connEventCount);
     else
-        return mapping_table[curUnmapped];
+        return csa1_computeChannel(curUnmapped);
+}
+
+// discard lookahead, next fill starts at the current event
+static void chanRingReset(void)
+{
+    chan_ring_reset(&chanRing, connEventCount, curUnmapped);
+}
+
+// compute channels for up to maxNew more upcoming events
+static void chanRingFill(uint32_t maxNew)
+{
+    chan_ring_fill(&chanRing, connEventCount, curUnmapped, hopIncrement, use_csa2, maxNew);
 }
 
 // performs channel hopping "housekeeping"
@@ -298,7 +352,7 @@ static void afterConnEvent(bool peripheral, bool gotData)
         else if (!rconf.intervalCertain && rconf.winOffsetCertain &&
                 itInd >= ARR_SZ(intervalTicks) && itInd != 0xFFFFFFFF)
         {
-            uint32_t medIntervalTicks = median(intervalTicks, ARR_SZ(intervalTicks));
+            uint32_t medIntervalTicks = median3(intervalTicks);
             uint32_t interval = (medIntervalTicks + 2500) / 5000; // snap to nearest multiple of 1.25 ms
             rconf.hopIntervalTicks = interval * 5000;
             rconf.intervalCertain = true;
@@ -306,19 +360,29 @@ static void afterConnEvent(bool peripheral, bool gotData)
 
             // clock drift compensator only works correctly when interval is correct
             // reset its state, and make sure we don't time out prematurely
-            for (uint32_t i = 0; i < ARR_SZ(anchorOffset); i++)
-                anchorOffset[i] = AO_TARG;
+            drift_pll_reset(&driftPll);
+            aoLead = AO_TARG;
             nextHopTime = lastAnchorTicks + rconf.hopIntervalTicks;
         }
     }
 
+    // as central, the peripheral's reply is the first packet we can receive
+    if (peripheral ? firstPacket : !gotData)
+        atomic_fetch_add(&g_perf.missedAnchors, 1);
+
     // last connection event is now "done"
+    atomic_fetch_add(&g_perf.hops, 1);
     curUnmapped = (curUnmapped + hopIncrement) % 37;
     connEventCount++;
+    uint32_t prevIntervalTicks = rconf.hopIntervalTicks;
     if (rconf_dequeue(connEventCount & 0xFFFF, &rconf))
     {
         nextHopTime += rconf.offset * 5000;
 
+        // drift per event scales with the interval
+        if (rconf.hopIntervalTicks != prevIntervalTicks)
+            drift_pll_rescale(&driftPll, prevIntervalTicks, rconf.hopIntervalTicks);
+
         computeMaps();
 
         if (instaHop && !rconf.intervalCertain)
@@ -329,14 +393,30 @@ static void afterConnEvent(bool peripheral, bool gotData)
     }
 
     // peripherals need to adjust for central clock drift
-    if (peripheral && rconf.intervalCertain &&
-            (connEventCount & (ARR_SZ(anchorOffset) - 1)) == 0)
+    if (peripheral && rconf.intervalCertain && rconf.winOffsetCertain)
     {
-        uint32_t medAnchorOffset = median(anchorOffset, ARR_SZ(anchorOffset));
-        nextHopTime += medAnchorOffset - AO_TARG;
+        uint32_t newLead;
+
+        if (!firstPacket)
+            nextHopTime += drift_pll_update(&driftPll, anchorErr);
+        else
+            nextHopTime += drift_pll_coast(&driftPll);
+
+        // hop as late as our confidence in the next anchor time allows,
+        // so we hear more of the current event
+        newLead = drift_pll_lead(&driftPll, AO_MIN, AO_TARG);
+        nextHopTime -= newLead - aoLead;
+        aoLead = newLead;
+
+        if ((connEventCount & (DRIFT_REPORT_EVENTS - 1)) == 0)
+            reportMeasDrift(drift_pll_ppb(&driftPll, rconf.hopIntervalTicks),
+                    aoLead, driftPll.jitterQ4);
     }
 
     nextHopTime += rconf.hopIntervalTicks;
+
+    // keep ahead of consumption, more is filled while idle before CENTRAL/PERIPHERAL events
+    chanRingFill(2);
 }
 
 static void radioTaskFunction(UArg arg0, UArg arg1)
@@ -355,9 +435,9 @@ static void radioTaskFunction(UArg arg0, UArg arg1)
             {
                 uint8_t chan;
                 PHY_Mode phy;
-                uint32_t aa = BLE_ADV_AA;
+                uint32_t aa, crcI;
                 uint32_t cur_t = RF_getCurrentTime();
-                uint32_t etime = AuxAdvScheduler_next(cur_t, &chan, &phy);
+                uint32_t etime = AuxAdvScheduler_next(cur_t, &chan, &phy, &aa, &crcI);
                 if (etime - LISTEN_TICKS_MIN - cur_t >= 0x80000000)
                     continue; // pointless to listen for tiny period, may stall radio with etime in past
                 if (chan == 0xFF)
@@ -365,12 +445,14 @@ static void radioTaskFunction(UArg arg0, UArg arg1)
                     chan = statChan;
                     phy = statPHY;
                     aa = accessAddress;
+                    crcI = statCRCI;
                 }
-                RadioWrapper_recvFrames(phy, chan, aa, statCRCI, etime, false, validateCrc,
+                listenAA = aa;
+                RadioWrapper_recvFrames(phy, chan, aa, crcI, 0, etime, false, validateCrc,
                         indicatePacket);
             } else {
                 /* receive forever (until stopped) */
-                RadioWrapper_recvFrames(statPHY, statChan, accessAddress, statCRCI, 0, true,
+                RadioWrapper_recvFrames(statPHY, statChan, accessAddress, statCRCI, 0, 0, true,
                         validateCrc, indicatePacket);
             }
         } else if (snifferState == ADVERT_SEEK) {
@@ -419,17 +501,20 @@ static void radioTaskFunction(UArg arg0, UArg arg1)
             {
                 uint8_t chan;
                 PHY_Mode phy;
+                uint32_t aa, crcI;
                 uint32_t cur_t = RF_getCurrentTime();
-                uint32_t etime = AuxAdvScheduler_next(cur_t, &chan, &phy);
+                uint32_t etime = AuxAdvScheduler_next(cur_t, &chan, &phy, &aa, &crcI);
                 if (etime - LISTEN_TICKS_MIN - cur_t >= 0x80000000)
                     continue; // pointless to listen for tiny period, may stall radio with etime in past
                 if (chan != 0xFF)
                 {
-                    RadioWrapper_recvFrames(phy, chan, BLE_ADV_AA, 0x555555, etime, false,
+                    listenAA = aa;
+                    RadioWrapper_recvFrames(phy, chan, aa, crcI, 0, etime, false,
                             validateCrc, indicatePacket);
                 } else {
+                    listenAA = BLE_ADV_AA;
                     // we need to force cancel recvAdv3 eventually
-                    DelayStopTrigger_trig((etime - RF_getCurrentTime()) >> 2);
+                    DelayStopTrigger_trigAt(etime);
                     RadioWrapper_recvAdv3(rconf.hopIntervalTicks - 60,
                             rconf.hopIntervalTicks + 5000, validateCrc, indicatePacket);
                 }
@@ -442,12 +527,25 @@ static void radioTaskFunction(UArg arg0, UArg arg1)
         } else if (snifferState == DATA) {
             uint8_t chan = getCurrChan();
             uint32_t timeExtension = rconf.winOffsetCertain ? 0 : rconf.hopIntervalTicks;
+            uint32_t listenEnd = nextHopTime + timeExtension;
             firstPacket = true;
             moreData = 0x3;
+
+            // Stop early enough to issue the next receive before it must start,
+            // so the RF core starts it on time rather than when we get to it
             RadioWrapper_recvFrames(rconf.phy, chan, accessAddress, crcInit,
-                    nextHopTime + timeExtension, false, validateCrc, indicatePacket);
+                    rxStartTime(dataListenTime),
+                    listenEnd - (HOP_TUNE_LISTEN_LATENCY + HOP_ISSUE_MARGIN)*4, false,
+                    validateCrc, indicatePacket);
+
+            // primary event ended early, use the rest of the interval
+            if (multiConn && rconf.intervalCertain && rconf.winOffsetCertain)
+                serviceGap();
 
             afterConnEvent(true, !firstPacket);
+
+            // the next event's channel should be heard from where this one ended
+            dataListenTime = listenEnd;
         } else if (snifferState == INITIATING) {
             uint32_t connTime;
             PHY_Mode connPhy;
@@ -521,6 +619,9 @@ static void radioTaskFunction(UArg arg0, UArg arg1)
                 TXQueue_flush(numSent);
             }
 
+            // use idle time before next event to refill hop lookahead
+            chanRingFill(CHAN_LOOKAHEAD);
+
             // Sleep till next event (till anchor offset before next anchor point)
             // 10us per tick for sleep, 0.25 us per radio tick
             uint32_t rticksRemaining = nextHopTime - RF_getCurrentTime();
@@ -550,6 +651,9 @@ static void radioTaskFunction(UArg arg0, UArg arg1)
                 TXQueue_flush(numSent);
             }
 
+            // use idle time before next event to refill hop lookahead
+            chanRingFill(CHAN_LOOKAHEAD);
+
             // Sleep till next event (till anchor offset before next anchor point)
             // 10us per tick for sleep, 0.25 us per radio tick
             uint32_t rticksRemaining = nextHopTime - RF_getCurrentTime();
@@ -593,35 +697,10 @@ static void computeMaps()
     if (use_csa2)
         csa2_computeMapping(accessAddress, rconf.chanMap);
     else
-        computeMap1(rconf.chanMap);
-}
-
-// Channel Selection Algorithm #1
-static void computeMap1(uint64_t map)
-{
-    uint8_t i, numUsedChannels = 0;
-    uint8_t remapping_table[37];
-
-    // count bits for numUsedChannels and generate remapping table
-    for (i = 0; i < 37; i++)
-    {
-        if (map & (1ULL << i))
-        {
-            remapping_table[numUsedChannels] = i;
-            numUsedChannels += 1;
-        }
-    }
+        csa1_computeMapping(rconf.chanMap);
 
-    // generate the actual map
-    for (i = 0; i < 37; i++)
-    {
-        if (map & (1ULL << i))
-            mapping_table[i] = i;
-        else {
-            uint8_t remappingIndex = i % numUsedChannels;
-            mapping_table[i] = remapping_table[remappingIndex];
-        }
-    }
+    // channels computed with the old map are stale
+    chanRingReset();
 }
 
 bool inDataState(void)
@@ -680,8 +759,23 @@ void reactToPDU(const BLE_Frame *frame)
             pduType == ADV_NONCONN_IND ||
             pduType == ADV_SCAN_IND)
         {
+            const AdvCacheEntry *cached = NULL;
+            if (advLen >= 6)
+                adv_cache_store(frame->pData + 2, frame);
+
             if (snifferState == ADVERT_SEEK) {
-                if (frame->channel == 37) {
+                if (frame->channel == 37 && advLen >= 6)
+                    cached = adv_cache_lookup(frame->pData + 2);
+
+                if (cached && cached->hopSamples >= 5) {
+                    // we've already measured this advertiser's hop interval, skip seeking
+                    rconf.hopIntervalTicks = cached->hopIntervalTicks;
+                    if (rconf.hopIntervalTicks - frame->length*32 < 380*4)
+                        fastAdvHop = true;
+                    reportMeasAdvHop(rconf.hopIntervalTicks >> 2);
+                    stateTransition(ADVERT_HOP);
+                    RadioWrapper_stop();
+                } else if (frame->channel == 37) {
                     // record timestamp and hop to next channel
                     lastAdvTimestamp = frame->timestamp;
                     RadioWrapper_trigAdv3();
@@ -760,7 +854,7 @@ void reactToPDU(const BLE_Frame *frame)
 
                 // Hop to 38 (with a delay) after we get an anchor advertisement on 37
                 // we do the math in 4 MHz radio ticks so that the timestamp integer overflow works
-                uint32_t targHopTime, timeRemaining;
+                uint32_t targHopTime;
 
                 if (!followConnections || pduType == ADV_NONCONN_IND) {
                     // schedule hop to 38 with time to retune before the ad on 38
@@ -780,13 +874,8 @@ void reactToPDU(const BLE_Frame *frame)
                     targHopTime = frame->timestamp + (frame->length + 8)*32 + hopDelay;
                 }
 
-                timeRemaining = targHopTime - RF_getCurrentTime();
-                if (timeRemaining >= 0x80000000)
-                    timeRemaining = 0; // interger underflow
-                else
-                    timeRemaining >>= 2; // convert to microseconds from radio ticks
-
-                DelayHopTrigger_trig(timeRemaining);
+                // hops immediately if the target time already passed
+                DelayHopTrigger_trigAt(targHopTime);
             }
         }
 
@@ -820,17 +909,15 @@ void reactToPDU(const BLE_Frame *frame)
             postponed = true;
         }
 
-        // For connectable legacy advertisements, save advertisement headers to the cache
-        // so that we can go back to check if the advertiser supports CSA#2.
+        // Legacy advertisements were saved to the cache above, so that we can go back
+        // to check if the advertiser supports CSA#2 when a CONNECT_IND arrives.
         if (pduType == ADV_IND ||
             pduType == ADV_DIRECT_IND)
-        {
-            adv_cache_store(frame->pData + 2, frame->pData[0]);
             return;
-        }
 
         // react to extended advert PDUs, but don't distract in the ADVERT_SEEK state
-        if (pduType == ADV_EXT_IND && auxAdvEnabled && snifferState != ADVERT_SEEK)
+        if (pduType == ADV_EXT_IND && auxAdvEnabled && snifferState != ADVERT_SEEK &&
+                snifferState != DATA)
         {
             reactToAdvExtPDU(frame, advLen);
             return;
@@ -840,27 +927,38 @@ void reactToPDU(const BLE_Frame *frame)
         if ((pduType == CONNECT_IND) && followConnections)
         {
             bool isAuxReq = frame->channel < 37;
+            bool csa2;
 
             // make sure body length is correct
             if (advLen != 34)
                 return;
 
             if (snifferState == ADVERTISING) {
-                use_csa2 = ChSel ? true : false;
+                csa2 = ChSel ? true : false;
             } else {
                 // Use CSA#2 if both initiator and advertiser support it
                 // AUX_CONNECT_REQ always uses CSA#2, ChSel is RFU
-                use_csa2 = isAuxReq ? true : false;
+                csa2 = isAuxReq ? true : false;
                 if (!isAuxReq && ChSel)
                 {
                     // check if advertiser supports it
                     uint8_t adv_hdr = adv_cache_fetch(frame->pData + 8);
                     if (adv_hdr != 0xFF && (adv_hdr & 0x20))
-                        use_csa2 = true;
+                        csa2 = true;
                 }
             }
 
+            // seen while scanning between primary connection events
+            if (snifferState == DATA)
+            {
+                if (!isAuxReq)
+                    conn_sched_add(frame->pData + 14,
+                            frame->timestamp + (frame->length + 8)*32, frame->phy, csa2);
+                return;
+            }
+
             // use_csa2 needs to be set before calling this
+            use_csa2 = csa2;
             handleConnReq(frame->phy, frame->timestamp, frame->pData + 14,
                     isAuxReq);
 
@@ -906,9 +1004,8 @@ static void reactToDataPDU(const BLE_Frame *frame, bool transmit)
      */
     if (firstPacket && !transmit)
     {
-        // compute anchor point offset from start of receive window
-        anchorOffset[aoInd] = frame->timestamp + rconf.hopIntervalTicks - nextHopTime;
-        aoInd = (aoInd + 1) & (ARR_SZ(anchorOffset) - 1);
+        // compute anchor point timing error relative to the receive window start
+        anchorErr = frame->timestamp + rconf.hopIntervalTicks - nextHopTime - aoLead;
         firstPacket = false;
 
         if (instaHop)
@@ -944,7 +1041,8 @@ static void reactToDataPDU(const BLE_Frame *frame, bool transmit)
     if (!MD)
         moreData &= ~(1 << g_pkt_dir);
 
-    if (ll_encryption && instaHop && !moreData && snifferState == DATA)
+    // hop early when we can't follow the event, or have other connections to follow
+    if (((ll_encryption && instaHop) || multiConn) && !moreData && snifferState == DATA)
         RadioWrapper_stop();
 
     // We only care about LL Control PDUs
@@ -1103,12 +1201,12 @@ static void reactToDataPDU(const BLE_Frame *frame, bool transmit)
 static void reactToAdvExtPDU(const BLE_Frame *frame, uint8_t advLen)
 {
     // First, we parse the Common Extended Advertising Payload
-    uint8_t *pAdvA __attribute__((unused)) = NULL;
+    uint8_t *pAdvA = NULL;
     uint8_t *pTargetA __attribute__((unused)) = NULL;
     uint8_t *pCTEInfo __attribute__((unused)) = NULL;
     uint8_t *pAdvDataInfo __attribute__((unused)) = NULL;
     uint8_t *pAuxPtr = NULL;
-    uint8_t *pSyncInfo __attribute__((unused)) = NULL;
+    uint8_t *pSyncInfo = NULL;
     uint8_t *pTxPower __attribute__((unused)) = NULL;
     uint8_t *pACAD __attribute__((unused)) = NULL;
     uint8_t ACADLen __attribute__((unused)) = 0;
@@ -1184,15 +1282,27 @@ static void reactToAdvExtPDU(const BLE_Frame *frame, uint8_t advLen)
         AdvDataLen = advLen - (hdrPos - 2);
     }
 
-    /* TODO: handle periodic advertising
-     * It's more complicated than I initially realized
-     * It's sort of half way between data and advertising
-     * It uses a custom access address and channel map
-     * I suspect it uses CSA#2 for hopping, but the spec is not obvious on this
-     * There's also a procedure for sync transfer from a link layer (data) connection
-     * In short: I don't have time to implement it today.
-     * The scheduler will need to be reworked to deal with this all.
+    /* Periodic advertising: AUX_SYNC_INDs use the train's own access address
+     * and hop with CSA#2 on the paEventCounter. Each one received while
+     * following a train re-anchors its timing to absorb clock drift.
+     * Sync transfer over a data connection (LL_PERIODIC_SYNC_IND) isn't handled.
      */
+    // remember secondary channel and PHY of extended advertisers
+    if (pAdvA && frame->channel < 37)
+        adv_cache_store(pAdvA, frame);
+
+    if (listenAA != BLE_ADV_AA)
+        AuxAdvScheduler_periodicRecv(listenAA, frame->timestamp);
+
+    if (pSyncInfo && snifferState != SCANNING && frame->channel < 37)
+    {
+        PHY_Mode phy = frame->phy;
+        if (AuxAdvScheduler_addPeriodic(pSyncInfo, phy, frame->timestamp))
+        {
+            // make sure the scheduler gets to see the new train in time
+            DelayStopTrigger_trig(5000);
+        }
+    }
 
     // Add AUX_ADV_INDs to the schedule
     if (pAuxPtr && snifferState != SCANNING)
@@ -1237,7 +1347,7 @@ static void reactToAdvExtPDU(const BLE_Frame *frame, uint8_t advLen)
         uint32_t ticksToStart = radioTimeStart - RF_getCurrentTime();
         if (ticksToStart > 0x80000000) ticksToStart = 0; // underflow
         if (ticksToStart < 5000 * 4)
-            DelayStopTrigger_trig(ticksToStart >> 2);
+            DelayStopTrigger_trigAt(radioTimeStart);
         else
             DelayStopTrigger_trig(5000);
     }
@@ -1293,6 +1403,15 @@ static void handleConnReq(PHY_Mode phy, uint32_t connTime, uint8_t *llData,
     connEventCount = 0;
     preloadedParamIndex = 0;
     rconf_reset();
+
+    drift_pll_reset(&driftPll);
+    aoLead = AO_TARG;
+
+    // the old connection's hop time means nothing for this one
+    dataListenTime = LISTEN_NOW;
+
+    // secondary connections are only followed alongside this one
+    conn_sched_reset();
 }
 
 static void handleConnFinished()
@@ -1300,10 +1419,73 @@ static void handleConnFinished()
     stateTransition(sniffDoneState);
     accessAddress = BLE_ADV_AA;
     AuxAdvScheduler_reset();
+    conn_sched_reset();
     if (snifferState != PAUSED && advHopEnabled)
         advHopSeekMode();
 }
 
+static void indicateSecondaryPacket(BLE_Frame *frame)
+{
+    bool done = conn_sched_frame(secConn, frame);
+    indicatePacket(frame);
+    if (done)
+        RadioWrapper_stop();
+}
+
+// Start time for a receive that must be listening by listenTime, leaving
+// the radio time to tune. A start time that already passed is kept, the RF
+// core then starts right away and the hop latency histogram records how late.
+// Returns 0 (start now) for LISTEN_NOW or a stale time.
+static uint32_t rxStartTime(uint32_t listenTime)
+{
+    uint32_t startTime = listenTime - HOP_TUNE_LISTEN_LATENCY*4;
+    uint32_t ahead = startTime - RF_getCurrentTime();
+
+    if (listenTime == LISTEN_NOW)
+        return 0;
+    if (ahead >= RX_START_MAX_TICKS && -ahead >= RX_START_MAX_TICKS)
+        return 0;
+    return startTime;
+}
+
+// Between primary connection events, follow secondary connections and
+// listen on an advertising channel for new ones
+static void serviceGap(void)
+{
+    uint8_t scanChan = statChan >= 37 ? statChan : 37;
+
+    while (snifferState == DATA)
+    {
+        uint32_t now = RF_getCurrentTime();
+        uint32_t gapEnd = nextHopTime - MULTI_GAP_GUARD;
+        uint32_t endTime;
+        ConnContext *c;
+
+        if (gapEnd - LISTEN_TICKS_MIN - now >= 0x80000000)
+            break; // too little time left, or already late
+
+        c = conn_sched_next(now, gapEnd, nextHopTime + aoLead + MULTI_PRIMARY_EVENT);
+        if (c && (int32_t)(conn_sched_listen_start(c) - now) < LISTEN_TICKS_MIN)
+        {
+            endTime = conn_sched_listen_end(c);
+            if (gapEnd - endTime >= 0x80000000)
+                endTime = gapEnd;
+
+            secConn = c;
+            conn_sched_event_start(c);
+            RadioWrapper_recvFrames(c->phy, conn_sched_channel(c), c->aa, c->crcInit,
+                    rxStartTime(conn_sched_listen_start(c)), endTime, false,
+                    validateCrc, indicateSecondaryPacket);
+            conn_sched_event_done(c);
+        } else {
+            // look for new connections until the next secondary event
+            endTime = c ? conn_sched_listen_start(c) : gapEnd;
+            RadioWrapper_recvFrames(PHY_1M, scanChan, BLE_ADV_AA, 0x555555,
+                    0, endTime, false, validateCrc, indicatePacket);
+        }
+    }
+}
+
 static void reactToTransmitted(dataQueue_t *pTXQ, uint32_t numEntries)
 {
     BLE_Frame f;
@@ -1410,6 +1592,7 @@ void sendMarker(const uint8_t *markerData, uint16_t len)
     frame.length = len;
     frame.direction = 0;
     frame.eventCtr = 0;
+    frame.connIdx = 0;
 
     // Does thread safe copying into queue
     indicatePacket(&frame);
@@ -1483,6 +1666,12 @@ void setInstaHop(bool enable)
     instaHop = enable;
 }
 
+/* Enable following other connections between events of the main one */
+void setMultiConn(bool enable)
+{
+    multiConn = enable;
+}
+
 /* Manually override the channel map for the current connection */
 void setChanMap(uint64_t map)
 {
@@ -64,6 +64,9 @@ void setAdvInterval(uint32_t intervalMs);
 /* Enable hopping to next channel immediately for encrypted conns */
 void setInstaHop(bool enable);
 
+/* Enable following other connections between events of the main one */
+void setMultiConn(bool enable);
+
 /* Manually override the channel map for the current connection */
 void setChanMap(uint64_t map);
 
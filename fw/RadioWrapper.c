@@ -9,6 +9,7 @@
  */
 #include <errno.h>
 #include <ti/sysbios/knl/Task.h>
+#include <ti/drivers/dpl/SwiP.h>
 
 // DriverLib
 #include <ti/drivers/rf/RF.h>
@@ -17,6 +18,7 @@
 #include "RadioWrapper.h"
 #include "ti_radio_config.h"
 #include "RadioTask.h"
+#include "perf_counters.h"
 
 #include DeviceFamily_constructPath(driverlib/rf_ble_mailbox.h)
 
@@ -27,9 +29,16 @@
 /* TX Configuration: */
 #define DATA_ENTRY_HEADER_SIZE 8    /* Constant header size of a Generic Data Entry */
 #define MAX_LENGTH             257  /* Max 8-bit length + two byte BLE header */
-#define NUM_DATA_ENTRIES       2    /* NOTE: Only two data entries supported at the moment */
+#ifdef RX_QUEUE_ENTRIES           /* Set per platform by makefile */
+#define NUM_DATA_ENTRIES       RX_QUEUE_ENTRIES
+#else
+#define NUM_DATA_ENTRIES       4
+#endif
 #define NUM_APPENDED_BYTES     7    /* Appended RSSI, appended status word, appended 4 byte timestamp*/
 
+/* Radio events handled by rx_int_callback */
+#define RX_IRQ_MASK            (IRQ_RX_ENTRY_DONE | IRQ_RX_BUF_FULL)
+
 /*********************************************************************
  * LOCAL VARIABLES
  */
@@ -46,14 +55,50 @@ static uint8_t rxDataEntryBuffer [RF_QUEUE_DATA_ENTRY_BUFFER_SIZE(NUM_DATA_ENTRI
             MAX_LENGTH, NUM_APPENDED_BYTES)] __attribute__ ((aligned (4)));
 
 static bool configured = false;
+
+// RAT compare channels available to the RF driver, and their callbacks
+#define RAT_CHANNELS 3
+// a compare armed closer than this may fire before RF_ratCompare even returns,
+// so leave well over the driver's call latency and let callers use a fallback
+#define RAT_COMPARE_MIN_TICKS (150 * 4)
+static volatile RadioWrapper_RatCallback ratCallbacks[RAT_CHANNELS];
 static bool ble4_cmd = false; // indicates one byte status word
 
 static RadioWrapper_Callback userCallback = NULL;
 
+/* RF core output for receive commands, to count packets lost to a full RX queue */
+static rfc_bleGenericRxOutput_t rxOutput[3];
+
+/* Advertising channel sniffing chain, built once by build_rx_templates */
+static rfc_bleGenericRxPar_t para37;
+static rfc_bleGenericRxPar_t para38;
+static rfc_bleGenericRxPar_t para39;
+static rfc_CMD_BLE5_GENERIC_RX_t sniff37;
+static rfc_CMD_BLE5_GENERIC_RX_t sniff38;
+static rfc_CMD_BLE5_GENERIC_RX_t sniff39;
+
+/* Generic RX parameters last written, so hops only patch what changed */
+static PHY_Mode rxPhy;
+static uint32_t rxAccessAddr;
+static uint32_t rxCrcInit;
+static bool rxValidateCrc;
+
+/* Hop latency: how late a receive command is issued, relative to its start time
+ * if it has one, otherwise to the scheduled end of the previous receive */
+#define HOP_LAT_MAX_TICKS (10000 * 4) /* longer gaps aren't hops */
+static uint32_t hopLatHist[HOP_LAT_BUCKETS];
+static uint32_t hopDeadline;
+static bool hopDeadlineValid = false;
+
 /*********************************************************************
  * LOCAL FUNCTIONS
  */
 static void rx_int_callback(RF_Handle h, RF_CmdHandle ch, RF_EventMask e);
+static void rx_process_entry(rfc_dataEntryGeneral_t *entry);
+static void rx_output_reset(void);
+static void rx_output_collect(void);
+static void build_rx_templates(void);
+static void run_rx_cmd(RF_Op *op, uint32_t startTime, bool bounded, uint32_t endTime);
 
 /*********************************************************************
  * PUBLIC FUNCTIONS
@@ -81,6 +126,8 @@ int RadioWrapper_init()
             return -ENOMEM;
         }
 
+        build_rx_templates();
+
         configured = true;
     }
 
@@ -94,6 +141,7 @@ int RadioWrapper_init()
 //  chan        Channel to listen on
 //  accessAddr  BLE access address of packet to listen for
 //  crcInit     Initial CRC value of packets being listened for
+//  startTime   When to start listening (in radio ticks), 0 for immediately
 //  timeout     When to stop listening (in radio ticks)
 //  forever     Ignore timeout and listen forever
 //  validateCrc Discard packets with invalid CRC
@@ -102,48 +150,79 @@ int RadioWrapper_init()
 // Returns:
 //  Status code (errno.h), 0 on success
 int RadioWrapper_recvFrames(PHY_Mode phy, uint32_t chan, uint32_t accessAddr,
-    uint32_t crcInit, uint32_t timeout, bool forever, bool validateCrc,
-    RadioWrapper_Callback callback)
+    uint32_t crcInit, uint32_t startTime, uint32_t timeout, bool forever,
+    bool validateCrc, RadioWrapper_Callback callback)
 {
+    rfc_bleGenericRxPar_t *pParams = RF_cmdBle5GenericRx.pParams;
+
     if ((!configured) || (chan >= 40))
         return -EINVAL;
 
     userCallback = callback;
     ble4_cmd = false;
 
-    /* set up the receive request */
+    /* patch the receive template, most hops only change the channel */
     RF_cmdBle5GenericRx.channel = chan;
     RF_cmdBle5GenericRx.whitening.init = 0x40 + chan;
-    RF_cmdBle5GenericRx.phyMode.mainMode = (phy == PHY_CODED_S2) ? 2 : phy;
-    RF_cmdBle5GenericRx.phyMode.coding = 0; // doesn't matter for receiver
-    RF_cmdBle5GenericRx.pParams->pRxQ = &dataQueue;
-    RF_cmdBle5GenericRx.pParams->accessAddress = accessAddr;
-    RF_cmdBle5GenericRx.pParams->crcInit0 = crcInit & 0xFF;
-    RF_cmdBle5GenericRx.pParams->crcInit1 = (crcInit >> 8) & 0xFF;
-    RF_cmdBle5GenericRx.pParams->crcInit2 = (crcInit >> 16) & 0xFF;
-    RF_cmdBle5GenericRx.pParams->bRepeat = 0x01; // receive multiple packets
-
-    RF_cmdBle5GenericRx.pParams->rxConfig.bAutoFlushIgnored = 1;
-    RF_cmdBle5GenericRx.pParams->rxConfig.bAutoFlushCrcErr = validateCrc ? 1 : 0;
-    RF_cmdBle5GenericRx.pParams->rxConfig.bAutoFlushEmpty = 0;
-    RF_cmdBle5GenericRx.pParams->rxConfig.bIncludeLenByte = 1;
-    RF_cmdBle5GenericRx.pParams->rxConfig.bIncludeCrc = 0;
-    RF_cmdBle5GenericRx.pParams->rxConfig.bAppendRssi = 1;
-    RF_cmdBle5GenericRx.pParams->rxConfig.bAppendStatus = 1;
-    RF_cmdBle5GenericRx.pParams->rxConfig.bAppendTimestamp = 1;
+    if (phy != rxPhy)
+    {
+        RF_cmdBle5GenericRx.phyMode.mainMode = (phy == PHY_CODED_S2) ? 2 : phy;
+        rxPhy = phy;
+    }
+    if (accessAddr != rxAccessAddr)
+    {
+        pParams->accessAddress = accessAddr;
+        rxAccessAddr = accessAddr;
+    }
+    if (crcInit != rxCrcInit)
+    {
+        pParams->crcInit0 = crcInit & 0xFF;
+        pParams->crcInit1 = (crcInit >> 8) & 0xFF;
+        pParams->crcInit2 = (crcInit >> 16) & 0xFF;
+        rxCrcInit = crcInit;
+    }
+    if (validateCrc != rxValidateCrc)
+    {
+        pParams->rxConfig.bAutoFlushCrcErr = validateCrc ? 1 : 0;
+        rxValidateCrc = validateCrc;
+    }
 
     if (forever)
     {
-        RF_cmdBle5GenericRx.pParams->endTrigger.triggerType = TRIG_NEVER;
-        RF_cmdBle5GenericRx.pParams->endTime = 0;
+        pParams->endTrigger.triggerType = TRIG_NEVER;
+        pParams->endTime = 0;
+    } else {
+        pParams->endTrigger.triggerType = TRIG_ABSTIME;
+        pParams->endTime = timeout;
+    }
+
+#ifdef HOP_SW_WAIT
+    // old behaviour for comparison: sleep till the start time, then start now
+    if (startTime != 0)
+    {
+        uint32_t rticksRemaining = startTime - RF_getCurrentTime();
+        if (rticksRemaining < 0x7FFFFFFF && rticksRemaining > 40)
+            Task_sleep(rticksRemaining / 40);
+    }
+    RF_cmdBle5GenericRx.startTrigger.triggerType = TRIG_NOW;
+#else
+    // let the RF core start on time rather than relying on task wakeup
+    if (startTime == 0)
+    {
+        RF_cmdBle5GenericRx.startTrigger.triggerType = TRIG_NOW;
     } else {
-        RF_cmdBle5GenericRx.pParams->endTrigger.triggerType = TRIG_ABSTIME;
-        RF_cmdBle5GenericRx.pParams->endTime = timeout;
+        RF_cmdBle5GenericRx.startTrigger.triggerType = TRIG_ABSTIME;
+        RF_cmdBle5GenericRx.startTrigger.pastTrig = 1;
+        RF_cmdBle5GenericRx.startTime = startTime;
     }
+#endif
+
+    rx_output_reset();
 
     /* Enter RX mode and stay in RX till timeout */
-    RF_runCmd(bleRfHandle, (RF_Op*)&RF_cmdBle5GenericRx, RF_PriorityNormal,
-            &rx_int_callback, IRQ_RX_ENTRY_DONE);
+    run_rx_cmd((RF_Op*)&RF_cmdBle5GenericRx, startTime, !forever, timeout);
+
+    rx_output_collect();
 
     return 0;
 }
@@ -163,91 +242,31 @@ int RadioWrapper_recvFrames(PHY_Mode phy, uint32_t chan, uint32_t accessAddr,
 int RadioWrapper_recvAdv3(uint32_t delay1, uint32_t delay2, bool validateCrc,
         RadioWrapper_Callback callback)
 {
-    rfc_bleGenericRxPar_t para37;
-    rfc_bleGenericRxPar_t para38;
-    rfc_bleGenericRxPar_t para39;
-    rfc_CMD_BLE5_GENERIC_RX_t sniff37;
-    rfc_CMD_BLE5_GENERIC_RX_t sniff38;
-    rfc_CMD_BLE5_GENERIC_RX_t sniff39;
-
     if (!configured)
         return -EINVAL;
 
     userCallback = callback;
     ble4_cmd = false;
 
-    // commom parameters for sniffing advertisements
-    para37.pRxQ = &dataQueue;
-    para37.accessAddress = 0x8E89BED6;
-    para37.crcInit0 = 0x55;
-    para37.crcInit1 = 0x55;
-    para37.crcInit2 = 0x55;
-    para37.bRepeat = 0x01; // receive multiple packets
-    para37.__dummy0 = 0x0000;
-    para37.rxConfig.bAutoFlushIgnored = 1;
+    // chain was built by build_rx_templates, only patch per call parameters
     para37.rxConfig.bAutoFlushCrcErr = validateCrc ? 1 : 0;
-    para37.rxConfig.bAutoFlushEmpty = 0;
-    para37.rxConfig.bIncludeLenByte = 1;
-    para37.rxConfig.bIncludeCrc = 0;
-    para37.rxConfig.bAppendRssi = 1;
-    para37.rxConfig.bAppendStatus = 1;
-    para37.rxConfig.bAppendTimestamp = 1;
-    para37.endTrigger.triggerType = TRIG_NEVER;
-    para37.endTrigger.bEnaCmd = 0;
-    para37.endTrigger.triggerNo = 0x0;
-    para37.endTrigger.pastTrig = 1;
-    para37.endTime = 0;
-
-    // set up the first generic RX struct
-    sniff37.commandNo = 0x1829;
-    sniff37.status = 0x0000;
-    sniff37.pNextOp = NULL;
-    sniff37.startTime = 0x00000000;
-    sniff37.startTrigger.triggerType = TRIG_NOW;
-    sniff37.startTrigger.bEnaCmd = 0;
-    sniff37.startTrigger.triggerNo = 0x0;
-    sniff37.startTrigger.pastTrig = 1;
-    sniff37.condition.rule = COND_ALWAYS;
-    sniff37.condition.nSkip = 0x0;
-    sniff37.channel = 0;
-    sniff37.whitening.init = 0x00;
-    sniff37.whitening.bOverride = 0;
-    sniff37.phyMode.mainMode = PHY_1M;
-    sniff37.phyMode.coding = 0x0;
-    sniff37.rangeDelay = 0x00;
-    sniff37.txPower = 0x0000;
-    sniff37.pParams = NULL;
-    sniff37.pOutput = NULL;
-    sniff37.tx20Power = 0x00000000;
-
-    // duplicate the default settings
-    para38 = para37;
-    para39 = para37;
-    sniff38 = sniff37;
-    sniff39 = sniff37;
+    para38.rxConfig.bAutoFlushCrcErr = validateCrc ? 1 : 0;
+    para39.rxConfig.bAutoFlushCrcErr = validateCrc ? 1 : 0;
 
     // sniff 37, wait for trigger, sniff 38, sniff 39
     sniff37.pNextOp = delay1 > 0 ? (RF_Op *)&sniff38 : (RF_Op *)&sniff39;
-    sniff37.pParams = &para37;
-    sniff37.channel = 37;
-    para37.endTrigger.triggerType = TRIG_NEVER;
-    para37.endTrigger.bEnaCmd = 1;
-
-    sniff38.pNextOp = (RF_Op *)&sniff39;
-    sniff38.pParams = &para38;
-    sniff38.channel = 38;
-    para38.endTrigger.triggerType = TRIG_REL_PREVEND;
     para38.endTime = delay1;
-
-    sniff39.pParams = &para39;
-    sniff39.channel = 39;
-    sniff39.condition.rule = COND_NEVER;
-    para39.endTrigger.triggerType = TRIG_REL_PREVEND;
     para39.endTime = delay2;
+    sniff37.status = IDLE;
+    sniff38.status = IDLE;
+    sniff39.status = IDLE;
+
+    rx_output_reset();
 
     // run the command chain
-    RF_runCmd(bleRfHandle, (RF_Op*)&sniff37, RF_PriorityNormal,
-            &rx_int_callback, IRQ_RX_ENTRY_DONE);
+    run_rx_cmd((RF_Op*)&sniff37, 0, false, 0);
+
+    rx_output_collect();
 
     return 0;
 }
@@ -256,6 +275,7 @@ void RadioWrapper_trigAdv3()
 {
     // trigger switch from chan 37 to 38
     RF_runDirectCmd(bleRfHandle, 0x04040001);
+    atomic_fetch_add(&g_perf.hops, 1);
 }
 
 /* Active Scanner
@@ -342,7 +362,7 @@ int RadioWrapper_scan(PHY_Mode phy, uint32_t chan, uint32_t timeout, bool foreve
 
     // Enter scanner mode and stay till timeout
     RF_runCmd(bleRfHandle, (RF_Op*)&RF_cmdBle5Scanner, RF_PriorityNormal,
-            &rx_int_callback, IRQ_RX_ENTRY_DONE);
+            &rx_int_callback, RX_IRQ_MASK);
 
     return 0;
 }
@@ -420,7 +440,7 @@ int RadioWrapper_scanLegacy(uint32_t chan, uint32_t timeout, bool forever,
 
     // Enter scanner mode and stay till timeout
     RF_runCmd(bleRfHandle, (RF_Op*)&RF_cmdBleScanner, RF_PriorityNormal,
-            &rx_int_callback, IRQ_RX_ENTRY_DONE);
+            &rx_int_callback, RX_IRQ_MASK);
 
     return 0;
 }
@@ -494,9 +514,10 @@ int RadioWrapper_central(PHY_Mode phy, uint32_t chan, uint32_t accessAddr,
 
     /* Enter central mode, and stay till we're done */
     RF_runCmd(bleRfHandle, (RF_Op*)&RF_cmdBle5Master, RF_PriorityNormal,
-            &rx_int_callback, IRQ_RX_ENTRY_DONE);
+            &rx_int_callback, RX_IRQ_MASK);
 
     *numSent = output.nTxEntryDone;
+    atomic_fetch_add(&g_perf.rxBufFull, output.nRxBufFull);
 
     switch (RF_cmdBle5Master.status)
     {
@@ -583,9 +604,10 @@ int RadioWrapper_peripheral(PHY_Mode phy, uint32_t chan, uint32_t accessAddr,
 
     /* Enter peripheral mode, and stay till we're done */
     RF_runCmd(bleRfHandle, (RF_Op*)&RF_cmdBle5Slave, RF_PriorityNormal,
-            &rx_int_callback, IRQ_RX_ENTRY_DONE);
+            &rx_int_callback, RX_IRQ_MASK);
 
     *numSent = output.nTxEntryDone;
+    atomic_fetch_add(&g_perf.rxBufFull, output.nRxBufFull);
 
     switch (RF_cmdBle5Slave.status)
     {
@@ -705,7 +727,7 @@ int RadioWrapper_initiate(PHY_Mode phy, uint32_t chan, uint32_t timeout, bool fo
 
     /* Enter initiator mode, and stay till we're done */
     RF_runCmd(bleRfHandle, (RF_Op*)&RF_cmdBle5Initiator, RF_PriorityNormal,
-            &rx_int_callback, IRQ_RX_ENTRY_DONE);
+            &rx_int_callback, RX_IRQ_MASK);
 
     *connTime = RF_cmdBle5Initiator.pParams->connectTime;
 
@@ -831,7 +853,7 @@ int RadioWrapper_advertise3(RadioWrapper_Callback callback, const uint16_t *advA
 
     /* Enter advertiser mode, and stay till we're done */
     RF_runCmd(bleRfHandle, (RF_Op*)&adv37, RF_PriorityNormal,
-            &rx_int_callback, IRQ_RX_ENTRY_DONE);
+            &rx_int_callback, RX_IRQ_MASK);
 
     if (adv37.status == BLE_DONE_CONNECT ||
             adv38.status == BLE_DONE_CONNECT ||
@@ -997,7 +1019,7 @@ int RadioWrapper_advertiseExt3(RadioWrapper_Callback callback, const uint16_t *a
 
     // Enter advertiser mode, and stay till we're done
     RF_runCmd(bleRfHandle, (RF_Op*)&adv37, RF_PriorityNormal,
-            &rx_int_callback, IRQ_RX_ENTRY_DONE);
+            &rx_int_callback, RX_IRQ_MASK);
 
     return adv2.status == BLE_DONE_CONNECT ? 0 : -1;
 }
@@ -1025,50 +1047,258 @@ void RadioWrapper_stop()
     RF_runDirectCmd(bleRfHandle, 0x04020001);
 }
 
-static void rx_int_callback(RF_Handle h, RF_CmdHandle ch, RF_EventMask e)
+static void rat_compare_cb(RF_Handle h, RF_RatHandle rh, RF_EventMask e,
+        uint32_t compareCaptureTime)
 {
-    BLE_Frame frame;
-    rfc_dataEntryGeneral_t *currentDataEntry;
-    uint8_t *packetPointer;
+    RadioWrapper_RatCallback cb;
 
-    if (e & RF_EventRxEntryDone)
-    {
-        /* Get current unhandled data entry */
-        currentDataEntry = RFQueue_getDataEntry();
-        packetPointer = (uint8_t *)(&currentDataEntry->data);
-
-        /* In the current radio configuration:
-         * Byte 0:      Advertisement/data PDU header
-         * Byte 1:      PDU body length (advert or data)
-         * Byte 2...:   PDU body
-         * Byte 2+l:    RSSI
-         * Byte 3+l:    Channel (and bIgnore, bCrcErr)
-         * Byte 4+l:    PHY mode (byte not present if ble4_cmd)
-         * Byte 5+l...: Timestamp (32 bit)
-         */
-        frame.length = packetPointer[1] + 2;
-        frame.pData = packetPointer;
+    if (rh < 0 || rh >= RAT_CHANNELS)
+        return;
+
+    cb = ratCallbacks[rh];
+    ratCallbacks[rh] = NULL;
+    if (cb && (e & RF_EventRatCh))
+        cb(compareCaptureTime);
+}
+
+int RadioWrapper_ratCompare(uint32_t ratTime, RadioWrapper_RatCallback callback)
+{
+    RF_RatConfigCompare conf;
+    RF_RatHandle rh;
+    uintptr_t key;
 
-        frame.rssi = (int8_t)packetPointer[frame.length];
-        frame.channel = packetPointer[frame.length + 1] & 0x3F;
-        frame.crcError = (packetPointer[frame.length + 1] & 0x80) ? 1 : 0;
+    // compare must be comfortably in the future for the RF driver to arm it
+    if (ratTime - RF_getCurrentTime() - RAT_COMPARE_MIN_TICKS >= 0x80000000)
+        return -1;
+
+    RF_RatConfigCompare_init(&conf);
+    conf.callback = rat_compare_cb;
+    conf.channel = RF_RatChannelAny;
+    conf.timeout = ratTime;
+
+    // the RF driver calls back from SWI context, so it must not run between
+    // arming the channel and storing the callback it looks up
+    key = SwiP_disable();
+    rh = RF_ratCompare(bleRfHandle, &conf, NULL);
+    if (rh >= 0 && rh < RAT_CHANNELS)
+        ratCallbacks[rh] = callback;
+    SwiP_restore(key);
+
+    if (rh < 0 || rh >= RAT_CHANNELS)
+        return -1;
+    return rh;
+}
 
-        if (ble4_cmd)
+void RadioWrapper_ratCancel(int channel)
+{
+    if (channel < 0 || channel >= RAT_CHANNELS)
+        return;
+
+    ratCallbacks[channel] = NULL;
+    RF_ratDisableChannel(bleRfHandle, (RF_RatHandle)channel);
+}
+
+// Fill in everything that doesn't change between hops once, so that
+// hopping only needs to patch channel and timing.
+static void build_rx_templates(void)
+{
+    rfc_bleGenericRxPar_t *pParams = RF_cmdBle5GenericRx.pParams;
+
+    // generic receive used by RadioWrapper_recvFrames
+    RF_cmdBle5GenericRx.phyMode.mainMode = PHY_1M;
+    RF_cmdBle5GenericRx.phyMode.coding = 0; // doesn't matter for receiver
+    RF_cmdBle5GenericRx.pOutput = rxOutput;
+    pParams->pRxQ = &dataQueue;
+    pParams->accessAddress = 0x8E89BED6;
+    pParams->crcInit0 = 0x55;
+    pParams->crcInit1 = 0x55;
+    pParams->crcInit2 = 0x55;
+    pParams->bRepeat = 0x01; // receive multiple packets
+    pParams->rxConfig.bAutoFlushIgnored = 1;
+    pParams->rxConfig.bAutoFlushCrcErr = 0;
+    pParams->rxConfig.bAutoFlushEmpty = 0;
+    pParams->rxConfig.bIncludeLenByte = 1;
+    pParams->rxConfig.bIncludeCrc = 0;
+    pParams->rxConfig.bAppendRssi = 1;
+    pParams->rxConfig.bAppendStatus = 1;
+    pParams->rxConfig.bAppendTimestamp = 1;
+    pParams->endTrigger.pastTrig = 1; // end right away if issued after the end time
+    rxPhy = PHY_1M;
+    rxAccessAddr = 0x8E89BED6;
+    rxCrcInit = 0x555555;
+    rxValidateCrc = false;
+
+    // commom parameters for sniffing advertisements
+    memset(&para37, 0, sizeof(para37));
+    para37.pRxQ = &dataQueue;
+    para37.accessAddress = 0x8E89BED6;
+    para37.crcInit0 = 0x55;
+    para37.crcInit1 = 0x55;
+    para37.crcInit2 = 0x55;
+    para37.bRepeat = 0x01; // receive multiple packets
+    para37.rxConfig.bAutoFlushIgnored = 1;
+    para37.rxConfig.bIncludeLenByte = 1;
+    para37.rxConfig.bAppendRssi = 1;
+    para37.rxConfig.bAppendStatus = 1;
+    para37.rxConfig.bAppendTimestamp = 1;
+    para37.endTrigger.pastTrig = 1;
+
+    // set up the first generic RX struct
+    memset(&sniff37, 0, sizeof(sniff37));
+    sniff37.commandNo = 0x1829;
+    sniff37.startTrigger.triggerType = TRIG_NOW;
+    sniff37.startTrigger.pastTrig = 1;
+    sniff37.condition.rule = COND_ALWAYS;
+    sniff37.phyMode.mainMode = PHY_1M;
+
+    // duplicate the default settings
+    para38 = para37;
+    para39 = para37;
+    sniff38 = sniff37;
+    sniff39 = sniff37;
+
+    // sniff 37 until triggered, then 38 and 39 each for a relative delay
+    sniff37.pParams = &para37;
+    sniff37.pOutput = rxOutput;
+    sniff37.channel = 37;
+    para37.endTrigger.triggerType = TRIG_NEVER;
+    para37.endTrigger.bEnaCmd = 1;
+
+    sniff38.pNextOp = (RF_Op *)&sniff39;
+    sniff38.pParams = &para38;
+    sniff38.pOutput = rxOutput + 1;
+    sniff38.channel = 38;
+    para38.endTrigger.triggerType = TRIG_REL_PREVEND;
+
+    sniff39.pParams = &para39;
+    sniff39.pOutput = rxOutput + 2;
+    sniff39.channel = 39;
+    sniff39.condition.rule = COND_NEVER;
+    para39.endTrigger.triggerType = TRIG_REL_PREVEND;
+}
+
+// bounded receives that run to their end time mark a hop deadline, and
+// the delay until the next receive command is issued gets recorded.
+// Commands with a start time are measured against that instead, and
+// count as on time when issued ahead of it.
+static void run_rx_cmd(RF_Op *op, uint32_t startTime, bool bounded, uint32_t endTime)
+{
+    if (startTime != 0)
+    {
+        hopDeadline = startTime;
+        hopDeadlineValid = true;
+    }
+
+    if (hopDeadlineValid)
+    {
+        uint32_t lat = RF_getCurrentTime() - hopDeadline;
+        if (lat >= 0x80000000)
+            lat = 0;
+        if (lat < HOP_LAT_MAX_TICKS)
         {
-            frame.phy = PHY_1M;
-            memcpy(&frame.timestamp, packetPointer + frame.length + 2, 4);
-        } else {
-            frame.phy = packetPointer[frame.length + 2] & 0x3;
-            memcpy(&frame.timestamp, packetPointer + frame.length + 3, 4);
+            uint32_t bucket = (lat >> 2) / HOP_LAT_BUCKET_US;
+            if (bucket >= HOP_LAT_BUCKETS)
+                bucket = HOP_LAT_BUCKETS - 1;
+            hopLatHist[bucket]++;
         }
+        hopDeadlineValid = false;
+    }
+
+    RF_runCmd(bleRfHandle, op, RF_PriorityNormal, &rx_int_callback, RX_IRQ_MASK);
+
+    // commands stopped early (eg. for a state change) don't count
+    if (bounded && RF_getCurrentTime() - endTime < 0x80000000)
+    {
+        hopDeadline = endTime;
+        hopDeadlineValid = true;
+    }
+}
 
-        /* gets overwritten with actual value in user callback */
-        frame.direction = 0;
-        frame.eventCtr = 0;
+void RadioWrapper_getHopLatency(uint32_t *hist)
+{
+    memcpy(hist, hopLatHist, sizeof(hopLatHist));
+}
 
-        if (userCallback) userCallback(&frame);
+void RadioWrapper_resetHopLatency(void)
+{
+    memset(hopLatHist, 0, sizeof(hopLatHist));
+}
+
+static void rx_output_reset(void)
+{
+    memset(rxOutput, 0, sizeof(rxOutput));
+}
+
+static void rx_output_collect(void)
+{
+    for (uint32_t i = 0; i < sizeof(rxOutput) / sizeof(rxOutput[0]); i++)
+        atomic_fetch_add(&g_perf.rxBufFull, rxOutput[i].nRxBufFull);
+}
+
+static void rx_process_entry(rfc_dataEntryGeneral_t *entry)
+{
+    BLE_Frame frame;
+    uint8_t *packetPointer = (uint8_t *)(&entry->data);
+
+    /* In the current radio configuration:
+     * Byte 0:      Advertisement/data PDU header
+     * Byte 1:      PDU body length (advert or data)
+     * Byte 2...:   PDU body
+     * Byte 2+l:    RSSI
+     * Byte 3+l:    Channel (and bIgnore, bCrcErr)
+     * Byte 4+l:    PHY mode (byte not present if ble4_cmd)
+     * Byte 5+l...: Timestamp (32 bit)
+     */
+    frame.length = packetPointer[1] + 2;
+    frame.pData = packetPointer;
+
+    frame.rssi = (int8_t)packetPointer[frame.length];
+    frame.channel = packetPointer[frame.length + 1] & 0x3F;
+    frame.crcError = (packetPointer[frame.length + 1] & 0x80) ? 1 : 0;
+
+    if (ble4_cmd)
+    {
+        frame.phy = PHY_1M;
+        memcpy(&frame.timestamp, packetPointer + frame.length + 2, 4);
+    } else {
+        frame.phy = packetPointer[frame.length + 2] & 0x3;
+        memcpy(&frame.timestamp, packetPointer + frame.length + 3, 4);
+    }
+
+    /* gets overwritten with actual value in user callback */
+    frame.direction = 0;
+    frame.eventCtr = 0;
+    frame.connIdx = 0;
+
+    if (frame.channel < 40)
+        atomic_fetch_add(&g_perf.rxFrames[frame.channel], 1);
+    if (frame.crcError)
+        atomic_fetch_add(&g_perf.crcErrors, 1);
+
+    if (userCallback) userCallback(&frame);
+}
+
+static void rx_int_callback(RF_Handle h, RF_CmdHandle ch, RF_EventMask e)
+{
+    if (e & RF_EventRxBufFull)
+        atomic_fetch_add(&g_perf.rxOverflows, 1);
+
+    if (e & RF_EventRxEntryDone)
+    {
+        uint32_t backlog = 0;
+
+        /* Several entries may have finished before we got to run (eg. during
+         * back to back packets), so handle every finished entry in order.
+         */
+        while (RFQueue_getDataEntry()->status == DATA_ENTRY_FINISHED)
+        {
+            rx_process_entry(RFQueue_getDataEntry());
+            RFQueue_nextEntry();
+            backlog++;
+        }
 
-        RFQueue_nextEntry();
+        if (backlog > atomic_load(&g_perf.rxBacklogMax))
+            atomic_store(&g_perf.rxBacklogMax, backlog);
     }
 }
 
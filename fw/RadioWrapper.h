@@ -49,6 +49,7 @@ typedef struct
     int8_t rssi;
     uint8_t channel:6;
     PHY_Mode phy:2;
+    uint8_t connIdx; // 0 for the primary (or only) connection
     uint8_t *pData;
 } BLE_Frame;
 
@@ -60,8 +61,8 @@ int RadioWrapper_close(void);
 
 // Sniff/Receive BLE packets
 int RadioWrapper_recvFrames(PHY_Mode phy, uint32_t chan, uint32_t accessAddr,
-    uint32_t crcInit, uint32_t timeout, bool forever, bool validateCrc,
-    RadioWrapper_Callback callback);
+    uint32_t crcInit, uint32_t startTime, uint32_t timeout, bool forever,
+    bool validateCrc, RadioWrapper_Callback callback);
 
 // Sniff channel 37, wait for trigger, sniff 38, sniff 39
 // Waits delay1 radio ticks before going from 38 to 39
@@ -118,6 +119,20 @@ void RadioWrapper_setTxPower(int8_t power);
 // Stop ongoing radio operations
 void RadioWrapper_stop();
 
+// Call back from software interrupt context when the radio timer reaches ratTime,
+// using a RAT compare channel. Returns a channel for RadioWrapper_ratCancel,
+// or a negative value if no channel was free or ratTime already passed.
+typedef void (*RadioWrapper_RatCallback)(uint32_t ratTime);
+int RadioWrapper_ratCompare(uint32_t ratTime, RadioWrapper_RatCallback callback);
+void RadioWrapper_ratCancel(int channel);
+
+// Histogram of how late receives are issued, relative to their start time if
+// given, otherwise to the previous receive ending at its scheduled time
+#define HOP_LAT_BUCKETS 32
+#define HOP_LAT_BUCKET_US 10 // last bucket also counts anything longer
+void RadioWrapper_getHopLatency(uint32_t *hist);
+void RadioWrapper_resetHopLatency(void);
+
 #ifdef __cplusplus
 }
 #endif
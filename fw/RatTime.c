@@ -0,0 +1,72 @@
+/*
+ * Written by Sultan Qasim Khan
+ * Copyright (c) 2024, NCC Group plc
+ * Released as open source under GPLv3
+ */
+
+// TI includes
+#include <ti/drivers/dpl/ClockP.h>
+#include <ti/drivers/dpl/HwiP.h>
+#include <ti/drivers/rf/RF.h>
+
+// Board Header file
+#include "ti_drivers_config.h"
+#include "ti_sysbios_config.h"
+
+// My includes
+#include <RatTime.h>
+
+// The high word is only advanced when a wrap of the low word is observed,
+// so we must look at the timer at least once per wrap period. Frame traffic
+// normally does this, the clock covers quiet periods.
+#define RAT_POLL_US 60000000
+
+static ClockP_Handle clk = NULL;
+
+static uint32_t lastLow = 0;
+static uint32_t high = 0;
+
+static void poll_tick(uintptr_t);
+
+void RatTime_init()
+{
+    ClockP_Params cparm;
+    ClockP_Params_init(&cparm);
+    cparm.period = RAT_POLL_US / Clock_tickPeriod_D;
+    cparm.startFlag = true;
+
+    clk = ClockP_create(poll_tick, RAT_POLL_US / Clock_tickPeriod_D, &cparm);
+    // shouldn't happen
+    if (clk == NULL)
+        while(1);
+}
+
+uint64_t RatTime_now()
+{
+    uintptr_t key;
+    uint32_t low;
+    uint64_t now;
+
+    key = HwiP_disable();
+    low = RF_getCurrentTime();
+    if (low < lastLow)
+        high++;
+    lastLow = low;
+    now = ((uint64_t)high << 32) | low;
+    HwiP_restore(key);
+
+    return now;
+}
+
+uint64_t RatTime_extend(uint32_t ratTicks)
+{
+    uint64_t now = RatTime_now();
+
+    // unsigned difference handles the timestamp being before a wrap
+    return now - (uint32_t)((uint32_t)now - ratTicks);
+}
+
+static void poll_tick(uintptr_t)
+{
+    RatTime_now();
+}
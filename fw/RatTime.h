@@ -0,0 +1,22 @@
+/*
+ * Written by Sultan Qasim Khan
+ * Copyright (c) 2024, NCC Group plc
+ * Released as open source under GPLv3
+ */
+
+#ifndef RATTIME_H
+#define RATTIME_H
+
+#include <stdint.h>
+
+// 64 bit extension of the 32 bit 4 MHz radio timer, which wraps every ~18 minutes
+
+void RatTime_init(void);
+
+// current extended radio time
+uint64_t RatTime_now(void);
+
+// extend a 32 bit radio timestamp from the past ~18 minutes
+uint64_t RatTime_extend(uint32_t ratTicks);
+
+#endif
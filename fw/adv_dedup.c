@@ -0,0 +1,167 @@
+/*
+ * Written by Sultan Qasim Khan
+ * Copyright (c) 2024, NCC Group plc
+ * Released as open source under GPLv3
+ */
+
+#include <string.h>
+#include <ti/drivers/dpl/HwiP.h>
+#include "adv_dedup.h"
+#include "measurements.h"
+#include "cache_util.h"
+
+// set associative table, each PDU hash maps to a set of DEDUP_WAYS entries
+// size must be a power of 2, makefile sets it per platform based on SRAM size
+#ifdef ADV_DEDUP_SIZE
+#define DEDUP_TABLE_SIZE ADV_DEDUP_SIZE
+#else
+#define DEDUP_TABLE_SIZE 64u
+#endif
+#define DEDUP_TABLE_MASK (DEDUP_TABLE_SIZE - 1)
+#define DEDUP_WAYS 4u
+#define DEDUP_SETS (DEDUP_TABLE_SIZE / DEDUP_WAYS)
+#define SET_MASK (DEDUP_SETS - 1)
+
+#if (DEDUP_TABLE_SIZE & DEDUP_TABLE_MASK) != 0 || DEDUP_TABLE_SIZE < DEDUP_WAYS
+#error "DEDUP_TABLE_SIZE must be a power of 2 of at least DEDUP_WAYS"
+#endif
+
+// legacy advertising PDU types that start with AdvA
+#define ADV_IND         0x0
+#define ADV_NONCONN_IND 0x2
+#define SCAN_RSP        0x4
+#define ADV_SCAN_IND    0x6
+
+typedef struct
+{
+    uint32_t hash;
+    uint32_t start;     // radio time of first copy in window
+    uint16_t count;     // copies seen in window, 0 if entry unused
+    int8_t rssiMin;
+    int8_t rssiMax;
+    uint8_t hdr;
+    uint8_t advA[6];
+} DedupEntry;
+
+static DedupEntry table[DEDUP_SETS][DEDUP_WAYS];
+static uint8_t clockHand[DEDUP_SETS];
+static uint8_t clockRefs[DEDUP_SETS]; // CLOCK reference bits, set on every suppressed copy
+static volatile uint32_t windowTicks = 0; // 4 MHz radio ticks
+static uint32_t sweepPos = 0;
+
+// 32 bit FNV-1a
+static uint32_t hashPDU(const uint8_t *buf, uint16_t len)
+{
+    uint32_t h = 2166136261u;
+    uint16_t i;
+
+    for (i = 0; i < len; i++)
+    {
+        h ^= buf[i];
+        h *= 16777619u;
+    }
+
+    return h;
+}
+
+// report window summary if any copies were suppressed, then free entry
+static void retireEntry(DedupEntry *e)
+{
+    if (e->count > 1)
+        reportMeasDedup(e->advA, e->hdr, e->hash, e->count, e->rssiMin, e->rssiMax);
+    e->count = 0;
+}
+
+
+// adv_dedup_check runs in the RF callback, so keep it out while resetting
+void adv_dedup_set_window(uint16_t window_ms)
+{
+    uintptr_t key;
+
+    key = HwiP_disable();
+    memset(table, 0, sizeof(table));
+    memset(clockHand, 0, sizeof(clockHand));
+    memset(clockRefs, 0, sizeof(clockRefs));
+    sweepPos = 0;
+    windowTicks = (uint32_t)window_ms * 4000;
+    HwiP_restore(key);
+}
+
+bool adv_dedup_check(const BLE_Frame *frame)
+{
+    DedupEntry *e, *slot = NULL;
+    uint32_t hash, set, i;
+    uint8_t pduType;
+
+    // legacy advertisements only appear on primary channels
+    if (!windowTicks || frame->channel < 37 || frame->crcError || frame->length < 8)
+        return false;
+
+    pduType = frame->pData[0] & 0xF;
+    if (pduType != ADV_IND && pduType != ADV_NONCONN_IND &&
+            pduType != SCAN_RSP && pduType != ADV_SCAN_IND)
+        return false;
+
+    // retire one stale entry per call so advertisers that go quiet still get
+    // their summary reported
+    e = &table[0][0] + sweepPos;
+    sweepPos = (sweepPos + 1) & DEDUP_TABLE_MASK;
+    if (e->count && frame->timestamp - e->start >= windowTicks)
+        retireEntry(e);
+
+    // key covers header, AdvA, and payload, but not channel or RSSI
+    hash = hashPDU(frame->pData, frame->length);
+    set = hash & SET_MASK;
+
+    for (i = 0; i < DEDUP_WAYS; i++)
+    {
+        e = &table[set][i];
+        if (!e->count)
+        {
+            if (!slot)
+                slot = e;
+            continue;
+        }
+
+        if (frame->timestamp - e->start >= windowTicks)
+        {
+            // window expired, summarize and reuse the entry
+            retireEntry(e);
+            if (!slot)
+                slot = e;
+            continue;
+        }
+
+        if (e->hash == hash)
+        {
+            if (e->count != 0xFFFF)
+                e->count++;
+            if (frame->rssi < e->rssiMin)
+                e->rssiMin = frame->rssi;
+            if (frame->rssi > e->rssiMax)
+                e->rssiMax = frame->rssi;
+            clock_ref(&clockRefs[set], i);
+            return true;
+        }
+    }
+
+    // all ways hold other advertisements still in their window,
+    // replace one that isn't still having copies suppressed
+    if (!slot)
+    {
+        slot = &table[set][clock_evict(&clockHand[set], &clockRefs[set], DEDUP_WAYS)];
+        retireEntry(slot);
+    }
+
+    e = slot;
+    e->hash = hash;
+    e->start = frame->timestamp;
+    e->count = 1;
+    e->rssiMin = frame->rssi;
+    e->rssiMax = frame->rssi;
+    e->hdr = frame->pData[0];
+    memcpy(e->advA, frame->pData + 2, 6);
+    clock_unref(&clockRefs[set], e - table[set]); // new entries start unreferenced
+
+    return false;
+}
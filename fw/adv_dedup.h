@@ -0,0 +1,20 @@
+/*
+ * Written by Sultan Qasim Khan
+ * Copyright (c) 2024, NCC Group plc
+ * Released as open source under GPLv3
+ */
+
+#ifndef ADV_DEDUP_H
+#define ADV_DEDUP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "RadioWrapper.h"
+
+// set duplicate suppression window in milliseconds, 0 to disable
+void adv_dedup_set_window(uint16_t window_ms);
+
+// returns true if frame repeats an advertisement seen within the window
+bool adv_dedup_check(const BLE_Frame *frame);
+
+#endif
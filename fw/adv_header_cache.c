@@ -6,37 +6,116 @@
 
 #include <string.h>
 #include "adv_header_cache.h"
+#include "cache_util.h"
 
-// cache size must be a power of 2
-#define HEADER_CACHE_SIZE 16
-#define CACHE_SIZE_MASK (HEADER_CACHE_SIZE - 1)
+// set associative cache, each MAC hashes to a set of ADV_CACHE_WAYS entries
+// size must be a power of 2, makefile sets it per platform based on SRAM size
+#ifdef ADV_CACHE_SIZE
+#define HEADER_CACHE_SIZE ADV_CACHE_SIZE
+#else
+#define HEADER_CACHE_SIZE 64u
+#endif
+#define ADV_CACHE_WAYS 4u
+#define ADV_CACHE_SETS (HEADER_CACHE_SIZE / ADV_CACHE_WAYS)
+#define SET_MASK (ADV_CACHE_SETS - 1)
 
-static uint8_t macs[HEADER_CACHE_SIZE][6];
-static uint8_t headers[HEADER_CACHE_SIZE];
-static int cache_pos = 0;
+#if (HEADER_CACHE_SIZE & (HEADER_CACHE_SIZE - 1)) != 0 || HEADER_CACHE_SIZE < ADV_CACHE_WAYS
+#error "HEADER_CACHE_SIZE must be a power of 2 of at least ADV_CACHE_WAYS"
+#endif
 
-void adv_cache_store(const uint8_t *mac, uint8_t hdr)
+#define FLAG_VALID  0x1
+
+// legacy advertising PDU types
+#define ADV_IND         0x0
+#define ADV_DIRECT_IND  0x1
+#define ADV_NONCONN_IND 0x2
+#define ADV_SCAN_IND    0x6
+
+// 37->38 hops further apart than this belong to different advertising events
+#define MAX_HOP_TICKS (10 * 4000)
+
+static AdvCacheEntry entries[ADV_CACHE_SETS][ADV_CACHE_WAYS];
+static uint8_t clockHand[ADV_CACHE_SETS];
+static uint8_t clockRefs[ADV_CACHE_SETS]; // CLOCK reference bits, set on every hit
+
+static inline uint32_t hashMac(const uint8_t *mac)
 {
-    memcpy(macs[cache_pos], mac, 6);
-    headers[cache_pos] = hdr;
-    cache_pos = (cache_pos + 1) & CACHE_SIZE_MASK;
+    return mac_hash(mac) & SET_MASK;
 }
 
-uint8_t adv_cache_fetch(const uint8_t *mac)
+static AdvCacheEntry *find(uint32_t set, const uint8_t *mac)
 {
-    uint8_t pos = (cache_pos - 1) & CACHE_SIZE_MASK;
-    uint8_t hdr = 0xFF; // invalid since it sets RFU bits
+    for (uint32_t i = 0; i < ADV_CACHE_WAYS; i++)
+    {
+        AdvCacheEntry *e = &entries[set][i];
+        if ((e->flags & FLAG_VALID) && !memcmp(e->mac, mac, 6))
+            return e;
+    }
+    return NULL;
+}
 
-    // work backwards fron newest to oldest
-    do
+static bool isLegacyAdv(uint8_t pduType)
+{
+    return pduType == ADV_IND || pduType == ADV_DIRECT_IND ||
+        pduType == ADV_NONCONN_IND || pduType == ADV_SCAN_IND;
+}
+
+void adv_cache_store(const uint8_t *mac, const BLE_Frame *frame)
+{
+    uint32_t set = hashMac(mac);
+    AdvCacheEntry *e = find(set, mac);
+    uint8_t pduType = frame->pData[0] & 0xF;
+    bool legacy = isLegacyAdv(pduType) && frame->channel >= 37;
+
+    if (!e)
     {
-        if (!memcmp(mac, macs[pos], 6))
+        // the evicted way is left unreferenced, as new entries should start
+        e = &entries[set][clock_evict(&clockHand[set], &clockRefs[set], ADV_CACHE_WAYS)];
+        memcpy(e->mac, mac, 6);
+        e->hdr = 0xFF; // invalid since it sets RFU bits
+        e->hopIntervalTicks = 0;
+        e->hopSamples = 0;
+        e->chan = 0;
+        e->flags = FLAG_VALID;
+    } else {
+        clock_ref(&clockRefs[set], e - entries[set]);
+
+        // measure hop interval the same way as ADVERT_SEEK
+        if (legacy && e->chan == 37 && frame->channel > 37)
         {
-            hdr = headers[pos];
-            break;
+            uint32_t delta = frame->timestamp - e->timestamp;
+            if (frame->channel == 39)
+                delta >>= 1; // assume we missed the ad on 38
+            if (delta < MAX_HOP_TICKS)
+            {
+                if (!e->hopIntervalTicks || delta < e->hopIntervalTicks)
+                    e->hopIntervalTicks = delta;
+                if (e->hopSamples < 0xFF)
+                    e->hopSamples++;
+            }
         }
-        pos = (pos - 1) & CACHE_SIZE_MASK;
-    } while (pos != cache_pos);
+    }
+
+    // only connectable legacy ads tell us if the advertiser supports CSA#2
+    if (pduType == ADV_IND || pduType == ADV_DIRECT_IND)
+        e->hdr = frame->pData[0];
+
+    e->chan = frame->channel;
+    e->phy = frame->phy;
+    e->timestamp = frame->timestamp;
+}
 
-    return hdr;
+const AdvCacheEntry *adv_cache_lookup(const uint8_t *mac)
+{
+    uint32_t set = hashMac(mac);
+    AdvCacheEntry *e = find(set, mac);
+    if (e)
+        clock_ref(&clockRefs[set], e - entries[set]);
+    return e;
+}
+
+uint8_t adv_cache_fetch(const uint8_t *mac)
+{
+    const AdvCacheEntry *e = adv_cache_lookup(mac);
+    return e ? e->hdr : 0xFF;
 }
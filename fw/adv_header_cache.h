@@ -8,8 +8,33 @@
 #define ADV_HEADER_CACHE_H
 
 #include <stdint.h>
+#include <stdbool.h>
+#include "RadioWrapper.h"
 
-void adv_cache_store(const uint8_t *mac, uint8_t hdr);
+typedef struct
+{
+    uint8_t mac[6];
+    uint8_t hdr;                // last connectable legacy header, 0xFF if none
+    uint8_t chan:6;             // channel of last advertisement
+    PHY_Mode phy:2;             // PHY of last advertisement
+    uint32_t timestamp;         // radio time of last advertisement
+    uint32_t hopIntervalTicks;  // shortest 37->38/39 hop seen, 0 if unknown
+    uint8_t hopSamples;         // number of hop interval measurements
+    uint8_t flags;
+} AdvCacheEntry;
+
+// Connection setup only uses the cached header, to tell whether the advertiser
+// supports CSA#2. Connection timing comes entirely from the CONNECT_IND itself
+// (its end time plus WinOffset and Interval from LLData), so the advertising
+// hop interval and timestamps are only used by ADVERT_SEEK/ADVERT_HOP.
+
+// record an advertisement from mac (AdvA) carried in frame
+void adv_cache_store(const uint8_t *mac, const BLE_Frame *frame);
+
+// returns NULL if the advertiser isn't cached
+const AdvCacheEntry *adv_cache_lookup(const uint8_t *mac);
+
+// returns 0xFF if no connectable legacy header is cached
 uint8_t adv_cache_fetch(const uint8_t *mac);
 
 #endif
@@ -0,0 +1,15 @@
+/*
+ * Written by Sultan Qasim Khan
+ * Copyright (c) 2024, NCC Group plc
+ * Released as open source under GPLv3
+ */
+
+#ifndef AES_BENCH_H
+#define AES_BENCH_H
+
+#include <stdint.h>
+
+// time and cross-check fast and reference software AES, report as a measurement
+void aes_bench_run(uint16_t blocks);
+
+#endif
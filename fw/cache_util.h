@@ -0,0 +1,50 @@
+/*
+ * Written by Sultan Qasim Khan
+ * Copyright (c) 2024, NCC Group plc
+ * Released as open source under GPLv3
+ */
+
+#ifndef CACHE_UTIL_H
+#define CACHE_UTIL_H
+
+#include <stdint.h>
+
+// Helpers shared by the firmware's hash tables (MAC list, advertiser cache,
+// advertisement dedup). Everything is inline since lookups run in RF callbacks.
+
+// Fibonacci hashing of the least significant 4 bytes, which vary the most.
+// Returns 16 bits, mask down to the table size.
+static inline uint32_t mac_hash(const uint8_t *mac)
+{
+    uint32_t v = mac[0] | (mac[1] << 8) | (mac[2] << 16) | ((uint32_t)mac[3] << 24);
+    v ^= (mac[4] | (mac[5] << 8)) << 7;
+    return (v * 2654435761u) >> 16;
+}
+
+// CLOCK replacement within one set of a set associative table.
+// Each set keeps a hand and a reference bit per way (ways a power of 2, up to 8).
+
+static inline void clock_ref(uint8_t *refs, uint32_t way)
+{
+    *refs |= 1 << way;
+}
+
+static inline void clock_unref(uint8_t *refs, uint32_t way)
+{
+    *refs &= ~(1 << way);
+}
+
+// skip over (and age) recently used ways, returns the way to replace
+static inline uint32_t clock_evict(uint8_t *hand, uint8_t *refs, uint32_t ways)
+{
+    while (1)
+    {
+        uint32_t way = *hand;
+        *hand = (way + 1) & (ways - 1);
+        if (!(*refs & (1 << way)))
+            return way;
+        clock_unref(refs, way);
+    }
+}
+
+#endif
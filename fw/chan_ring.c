@@ -0,0 +1,42 @@
+/*
+ * Written by Sultan Qasim Khan
+ * Copyright (c) 2024, NCC Group plc
+ * Released as open source under GPLv3
+ */
+
+#include "chan_ring.h"
+#include "csa1.h"
+#include "csa2.h"
+
+void chan_ring_reset(ChanRing *r, uint32_t eventCount, uint8_t curUnmapped)
+{
+    r->start = eventCount;
+    r->count = 0;
+    r->unmapped = curUnmapped;
+}
+
+void chan_ring_fill(ChanRing *r, uint32_t eventCount, uint8_t curUnmapped,
+        uint8_t hopIncrement, bool csa2, uint32_t maxNew)
+{
+    // drop entries for past events, or start over if the event counter jumped
+    if (eventCount - r->start > r->count)
+        chan_ring_reset(r, eventCount, curUnmapped);
+    else
+    {
+        r->count -= eventCount - r->start;
+        r->start = eventCount;
+    }
+
+    while (r->count < CHAN_LOOKAHEAD && maxNew--)
+    {
+        uint32_t ev = r->start + r->count;
+        if (csa2)
+            r->chans[ev & CHAN_LOOKAHEAD_MASK] = csa2_computeChannel(ev);
+        else
+        {
+            r->chans[ev & CHAN_LOOKAHEAD_MASK] = csa1_computeChannel(r->unmapped);
+            r->unmapped = (r->unmapped + hopIncrement) % 37;
+        }
+        r->count++;
+    }
+}
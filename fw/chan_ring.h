@@ -0,0 +1,43 @@
+/*
+ * Written by Sultan Qasim Khan
+ * Copyright (c) 2024, NCC Group plc
+ * Released as open source under GPLv3
+ */
+
+#ifndef CHAN_RING_H
+#define CHAN_RING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Lookahead ring of channels for upcoming connection events, computed with
+// the csa1 or csa2 connection mapping. Must be reset when the mapping changes.
+#define CHAN_LOOKAHEAD 16 // power of 2
+#define CHAN_LOOKAHEAD_MASK (CHAN_LOOKAHEAD - 1)
+
+typedef struct
+{
+    uint8_t chans[CHAN_LOOKAHEAD];
+    uint32_t start;     // event counter of oldest entry
+    uint32_t count;     // valid entries starting at start
+    uint8_t unmapped;   // CSA #1 unmapped channel for next entry filled
+} ChanRing;
+
+// discard lookahead, next fill starts at eventCount
+// curUnmapped is the CSA #1 unmapped channel of eventCount
+void chan_ring_reset(ChanRing *r, uint32_t eventCount, uint8_t curUnmapped);
+
+// drop entries before eventCount, then compute channels for up to maxNew more events
+void chan_ring_fill(ChanRing *r, uint32_t eventCount, uint8_t curUnmapped,
+        uint8_t hopIncrement, bool csa2, uint32_t maxNew);
+
+// returns false if the ring doesn't cover eventCount
+static inline bool chan_ring_lookup(const ChanRing *r, uint32_t eventCount, uint8_t *chan)
+{
+    if (eventCount - r->start >= r->count)
+        return false;
+    *chan = r->chans[eventCount & CHAN_LOOKAHEAD_MASK];
+    return true;
+}
+
+#endif
@@ -0,0 +1,105 @@
+/*
+ * Written by Sultan Qasim Khan
+ * Copyright (c) 2024, NCC Group plc
+ * Released as open source under GPLv3
+ */
+
+#include "cobs.h"
+
+void cobs_encode_begin(COBS_Encoder *enc, uint8_t *dst)
+{
+    enc->dst = dst;
+    enc->code_idx = 0;
+    enc->enc_len = 1;
+    enc->code = 1;
+}
+
+void cobs_encode_update(COBS_Encoder *enc, const uint8_t *src, uint32_t src_len)
+{
+    uint8_t *dst = enc->dst;
+    uint32_t code_idx = enc->code_idx;
+    uint32_t j = enc->enc_len;
+    uint8_t code = enc->code;
+
+    for (uint32_t i = 0; i < src_len; i++)
+    {
+        if (src[i] == 0)
+        {
+            dst[code_idx] = code;
+            code_idx = j++;
+            code = 1;
+        } else {
+            dst[j++] = src[i];
+            code++;
+            if (code == 0xFF)
+            {
+                dst[code_idx] = code;
+                code_idx = j++;
+                code = 1;
+            }
+        }
+    }
+
+    enc->code_idx = code_idx;
+    enc->enc_len = j;
+    enc->code = code;
+}
+
+uint32_t cobs_encode_end(COBS_Encoder *enc)
+{
+    enc->dst[enc->code_idx] = enc->code;
+    return enc->enc_len;
+}
+
+uint32_t cobs_encode(uint8_t *dst, const uint8_t *src, uint32_t src_len)
+{
+    COBS_Encoder enc;
+
+    cobs_encode_begin(&enc, dst);
+    cobs_encode_update(&enc, src, src_len);
+    return cobs_encode_end(&enc);
+}
+
+int cobs_decode(uint8_t *dst, const uint8_t *src, uint32_t src_len)
+{
+    uint32_t i = 0, j = 0;
+
+    while (i < src_len)
+    {
+        uint8_t code = src[i++];
+        if (code == 0 || i + code - 1 > src_len)
+            return -1;
+
+        for (uint8_t k = 1; k < code; k++)
+        {
+            if (src[i] == 0)
+                return -2;
+            dst[j++] = src[i++];
+        }
+
+        // a zero is implied after every block except 0xFF blocks and the last
+        if (code != 0xFF && i < src_len)
+            dst[j++] = 0;
+    }
+
+    return (int)j;
+}
+
+// nibble table keeps flash cost at 32 bytes while avoiding a bitwise loop
+static const uint16_t crc16_nibble_table[16] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+
+uint16_t crc16_ccitt(const uint8_t *buf, uint32_t len)
+{
+    uint16_t crc = 0xFFFF;
+
+    for (uint32_t i = 0; i < len; i++)
+    {
+        crc = (crc << 4) ^ crc16_nibble_table[(crc >> 12) ^ (buf[i] >> 4)];
+        crc = (crc << 4) ^ crc16_nibble_table[(crc >> 12) ^ (buf[i] & 0xF)];
+    }
+
+    return crc;
+}
@@ -0,0 +1,37 @@
+/*
+ * Written by Sultan Qasim Khan
+ * Copyright (c) 2024, NCC Group plc
+ * Released as open source under GPLv3
+ */
+
+#ifndef COBS_H
+#define COBS_H
+
+#include <stdint.h>
+
+// worst case encoded length (excluding frame delimiter)
+#define COBS_MAX_ENC_LEN(n) ((n) + ((n) / 254) + 1)
+
+// incremental encoder, for encoding discontiguous buffers as one frame
+typedef struct
+{
+    uint8_t *dst;
+    uint32_t code_idx;
+    uint32_t enc_len;
+    uint8_t code;
+} COBS_Encoder;
+
+void cobs_encode_begin(COBS_Encoder *enc, uint8_t *dst);
+void cobs_encode_update(COBS_Encoder *enc, const uint8_t *src, uint32_t src_len);
+uint32_t cobs_encode_end(COBS_Encoder *enc); // returns encoded length
+
+// cobs_encode returns encoded length; output contains no zero bytes
+// cobs_decode returns decoded length, or negative on malformed input
+// both assume dst buffer is large enough given src_len
+uint32_t cobs_encode(uint8_t *dst, const uint8_t *src, uint32_t src_len);
+int cobs_decode(uint8_t *dst, const uint8_t *src, uint32_t src_len);
+
+// CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF), used as the frame trailer
+uint16_t crc16_ccitt(const uint8_t *buf, uint32_t len);
+
+#endif
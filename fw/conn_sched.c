@@ -0,0 +1,267 @@
+/*
+ * Written by Sultan Qasim Khan
+ * Copyright (c) 2024, NCC Group plc
+ * Released as open source under GPLv3
+ */
+
+#include <string.h>
+#include "conn_sched.h"
+#include "measurements.h"
+
+// Listen this early before the expected anchor. The minimum covers
+// retuning latency, as with the primary connection.
+#define LEAD_MIN_TICKS  ((300 + 50) * 4)
+#define LEAD_MAX_TICKS  2000
+
+// Keep listening this long past the anchor window for the rest of the event.
+// Events normally end sooner when neither side has more data.
+#define EVENT_TICKS     12000
+
+// report statistics after this many events listened to (power of 2)
+#define REPORT_EVENTS   256
+
+static ConnContext conns[MAX_CONNS];
+
+// true if radio time a is before b, tolerant of wraparound
+static inline bool before(uint32_t a, uint32_t b)
+{
+    return (a - b) >= 0x80000000;
+}
+
+static uint32_t lead(const ConnContext *c)
+{
+    if (!c->synced)
+        return LEAD_MAX_TICKS;
+    return drift_pll_lead(&c->pll, LEAD_MIN_TICKS, LEAD_MAX_TICKS);
+}
+
+// past this time, the anchor packet can no longer be caught
+static uint32_t anchor_end(const ConnContext *c)
+{
+    return c->nextAnchor + c->window + lead(c);
+}
+
+// move on to the next event, applying drift correction
+static void advance(ConnContext *c, int32_t corr)
+{
+    c->nextAnchor += c->intervalTicks + corr;
+    c->curUnmapped = (c->curUnmapped + c->hopIncrement) % 37;
+    c->eventCtr++;
+}
+
+static void skip(ConnContext *c, bool collision)
+{
+    c->skipped++;
+    if (collision)
+        c->collisions++;
+    advance(c, c->synced ? drift_pll_coast(&c->pll) : 0);
+}
+
+void conn_sched_reset(void)
+{
+    memset(conns, 0, sizeof(conns));
+}
+
+ConnContext *conn_sched_add(const uint8_t *llData, uint32_t connEnd, PHY_Mode phy,
+        bool useCsa2)
+{
+    ConnContext *c = NULL;
+    uint32_t aa, i;
+    uint64_t chanMap = 0;
+    uint16_t winSize, winOffset, interval, timeout;
+
+    memcpy(&aa, llData, sizeof(aa));
+    for (i = 1; i < MAX_CONNS; i++)
+    {
+        if (conns[i].active && conns[i].aa == aa)
+            return NULL;
+        if (!conns[i].active && !c)
+            c = &conns[i];
+    }
+    if (!c)
+    {
+        // let the host know there's a connection we aren't following
+        ConnContext r;
+        memset(&r, 0, sizeof(ConnContext));
+        r.idx = 0xFF;
+        r.aa = aa;
+        r.crcInit = (llData[4] | (llData[5] << 8) | (llData[6] << 16));
+        memcpy(&interval, llData + 10, sizeof(interval));
+        r.intervalTicks = interval * 5000;
+        reportMeasConn(&r, CONN_REJECTED);
+        return NULL;
+    }
+
+    winSize = llData[7];
+    memcpy(&winOffset, llData + 8, sizeof(winOffset));
+    memcpy(&interval, llData + 10, sizeof(interval));
+    memcpy(&timeout, llData + 14, sizeof(timeout));
+    memcpy(&chanMap, llData + 16, 5);
+    chanMap &= 0x1FFFFFFFFFULL;
+
+    // ignore garbage that would stall the scheduler
+    if (interval < 6 || interval > 3200)
+        return NULL;
+
+    memset(c, 0, sizeof(ConnContext));
+    c->idx = c - conns;
+    c->aa = aa;
+    c->crcInit = (llData[4] | (llData[5] << 8) | (llData[6] << 16));
+    c->phy = phy;
+    c->useCsa2 = useCsa2;
+    c->hopIncrement = llData[21] & 0x1F;
+    c->curUnmapped = c->hopIncrement;
+    csa2_initContext(&c->map, aa, chanMap);
+    if (c->map.numUsedChannels < 2)
+        return NULL;
+
+    // first anchor is somewhere in the transmit window, 1.25 ms after CONNECT_IND
+    c->intervalTicks = interval * 5000;
+    c->nextAnchor = connEnd + 5000 + winOffset * 5000;
+    c->window = winSize * 5000;
+    c->timeoutTicks = timeout * 40000;
+
+    // spec allows 6 events to establish the connection
+    c->timeoutTime = c->nextAnchor + c->window + c->intervalTicks * 6;
+
+    drift_pll_reset(&c->pll);
+    c->active = true;
+    reportMeasConn(c, CONN_ADDED);
+
+    return c;
+}
+
+ConnContext *conn_sched_next(uint32_t now, uint32_t gapEnd, uint32_t primaryEnd)
+{
+    ConnContext *best = NULL;
+    uint32_t i;
+
+    for (i = 1; i < MAX_CONNS; i++)
+    {
+        ConnContext *c = &conns[i];
+        uint32_t start;
+
+        if (!c->active)
+            continue;
+
+        if (before(c->timeoutTime, now))
+        {
+            c->active = false;
+            reportMeasConn(c, CONN_LOST);
+            continue;
+        }
+
+        // catch up on events we couldn't listen to
+        for (;;)
+        {
+            start = conn_sched_listen_start(c);
+            if (before(anchor_end(c), now))
+                skip(c, false);
+            else if (!before(start, gapEnd) && before(start, primaryEnd))
+                skip(c, true);
+            else
+                break;
+        }
+
+        if (!before(start, gapEnd))
+            continue; // fits a later gap
+        if (!best || before(start, conn_sched_listen_start(best)))
+            best = c;
+    }
+
+    if (!best)
+        return NULL;
+
+    // other events starting before the chosen anchor is caught lose out
+    for (i = 1; i < MAX_CONNS; i++)
+    {
+        ConnContext *c = &conns[i];
+        if (!c->active || c == best)
+            continue;
+        if (before(conn_sched_listen_start(c), anchor_end(best)))
+            skip(c, true);
+    }
+
+    return best;
+}
+
+uint8_t conn_sched_channel(const ConnContext *c)
+{
+    uint8_t chan;
+
+    if (c->useCsa2)
+        return csa2_contextChannel(&c->map, c->eventCtr);
+
+    // Channel Selection Algorithm #1
+    chan = c->curUnmapped;
+    if (!(c->map.chanMap & (1ULL << chan)))
+        chan = c->map.remapping_table[chan % c->map.numUsedChannels];
+    return chan;
+}
+
+uint32_t conn_sched_listen_start(const ConnContext *c)
+{
+    return c->nextAnchor - lead(c);
+}
+
+uint32_t conn_sched_listen_end(const ConnContext *c)
+{
+    return anchor_end(c) + EVENT_TICKS;
+}
+
+void conn_sched_event_start(ConnContext *c)
+{
+    c->gotAnchor = false;
+    c->dir = 0;
+    c->moreData = 0x3;
+}
+
+bool conn_sched_frame(ConnContext *c, BLE_Frame *frame)
+{
+    frame->connIdx = c->idx;
+    frame->direction = c->dir;
+    frame->eventCtr = c->eventCtr;
+
+    if (frame->crcError)
+        return false;
+
+    // first packet of each event is the anchor, sent by the central
+    if (!c->gotAnchor)
+    {
+        c->gotAnchor = true;
+        c->anchorTime = frame->timestamp;
+    }
+    c->dir ^= 1;
+
+    if (frame->length >= 2 && !(frame->pData[0] & 0x10))
+        c->moreData &= ~(1 << frame->direction);
+
+    return !c->moreData;
+}
+
+void conn_sched_event_done(ConnContext *c)
+{
+    int32_t corr = 0;
+
+    c->events++;
+    if (c->gotAnchor)
+    {
+        c->anchors++;
+        c->timeoutTime = c->anchorTime + c->timeoutTicks;
+        if (c->synced) {
+            corr = drift_pll_update(&c->pll, c->anchorTime - c->nextAnchor);
+        } else {
+            // now we know where in the transmit window the connection started
+            c->nextAnchor = c->anchorTime;
+            c->window = 0;
+            c->synced = true;
+        }
+    } else if (c->synced) {
+        corr = drift_pll_coast(&c->pll);
+    }
+
+    advance(c, corr);
+
+    if ((c->events & (REPORT_EVENTS - 1)) == 0)
+        reportMeasConn(c, CONN_STATS);
+}
@@ -0,0 +1,83 @@
+/*
+ * Written by Sultan Qasim Khan
+ * Copyright (c) 2024, NCC Group plc
+ * Released as open source under GPLv3
+ */
+
+#ifndef CONN_SCHED_H
+#define CONN_SCHED_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "csa2.h"
+#include "drift_pll.h"
+#include "RadioWrapper.h"
+
+// Connection slots, including the primary connection at index 0.
+// The primary is tracked by RadioTask itself, only secondaries live here.
+#define MAX_CONNS 4
+
+// reasons for connection reports
+#define CONN_ADDED  0
+#define CONN_STATS  1
+#define CONN_LOST   2
+#define CONN_REJECTED 3 // no free slot, reported with index 0xFF
+
+// Secondary connection followed in the gaps between primary connection events.
+// All times are in 4 MHz radio ticks.
+typedef struct
+{
+    CSA2_Context map;       // remapping table is shared by CSA#1 and CSA#2
+    DriftPLL pll;
+    uint32_t aa;
+    uint32_t crcInit;
+    uint32_t intervalTicks;
+    uint32_t nextAnchor;    // expected anchor time of event eventCtr
+    uint32_t window;        // anchor uncertainty until the first anchor is seen
+    uint32_t timeoutTicks;
+    uint32_t timeoutTime;
+    uint32_t anchorTime;    // anchor seen during current event
+    uint32_t events;        // events listened to
+    uint32_t anchors;       // events where the anchor packet was captured
+    uint32_t skipped;       // events not listened to
+    uint32_t collisions;    // skipped events that overlapped another connection
+    uint16_t eventCtr;
+    PHY_Mode phy;
+    uint8_t idx;
+    bool active;
+    bool synced;
+    bool useCsa2;
+    uint8_t hopIncrement;
+    uint8_t curUnmapped;
+
+    // per event state, updated from the radio callback
+    bool gotAnchor;
+    uint8_t dir;
+    uint8_t moreData;
+} ConnContext;
+
+void conn_sched_reset(void);
+
+// llData is the CONNECT_IND LLData, connEnd is when the CONNECT_IND ended
+// returns NULL if all slots are in use or the connection is already followed
+ConnContext *conn_sched_add(const uint8_t *llData, uint32_t connEnd, PHY_Mode phy,
+        bool useCsa2);
+
+// Pick the secondary event to listen to next, starting before gapEnd.
+// Events that already passed, or would overlap the primary connection event
+// between gapEnd and primaryEnd, are skipped. Returns NULL if none fits.
+ConnContext *conn_sched_next(uint32_t now, uint32_t gapEnd, uint32_t primaryEnd);
+
+uint8_t conn_sched_channel(const ConnContext *c);
+uint32_t conn_sched_listen_start(const ConnContext *c);
+uint32_t conn_sched_listen_end(const ConnContext *c);
+
+void conn_sched_event_start(ConnContext *c);
+
+// tags a frame received during the event, returns true once the event is over
+bool conn_sched_frame(ConnContext *c, BLE_Frame *frame);
+
+void conn_sched_event_done(ConnContext *c);
+
+#endif
@@ -0,0 +1,41 @@
+/*
+ * Written by Sultan Qasim Khan
+ * Copyright (c) 2018, NCC Group plc
+ * Released as open source under GPLv3
+ */
+
+#include "csa1.h"
+
+static uint8_t mapping_table[37];
+
+void csa1_computeMapping(uint64_t map)
+{
+    uint8_t i, numUsedChannels = 0;
+    uint8_t remapping_table[37];
+
+    // count bits for numUsedChannels and generate remapping table
+    for (i = 0; i < 37; i++)
+    {
+        if (map & (1ULL << i))
+        {
+            remapping_table[numUsedChannels] = i;
+            numUsedChannels += 1;
+        }
+    }
+
+    // generate the actual map
+    for (i = 0; i < 37; i++)
+    {
+        if (map & (1ULL << i))
+            mapping_table[i] = i;
+        else {
+            uint8_t remappingIndex = i % numUsedChannels;
+            mapping_table[i] = remapping_table[remappingIndex];
+        }
+    }
+}
+
+uint8_t csa1_computeChannel(uint8_t unmappedChannel)
+{
+    return mapping_table[unmappedChannel];
+}
@@ -0,0 +1,18 @@
+/*
+ * Written by Sultan Qasim Khan
+ * Copyright (c) 2018, NCC Group plc
+ * Released as open source under GPLv3
+ */
+
+#ifndef CSA1_H
+#define CSA1_H
+
+#include <stdint.h>
+
+// Channel Selection Algorithm #1, connection hopping using internal mapping table
+void csa1_computeMapping(uint64_t map);
+
+// the caller advances unmappedChannel by the hop increment (mod 37) each event
+uint8_t csa1_computeChannel(uint8_t unmappedChannel);
+
+#endif
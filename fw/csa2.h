@@ -9,7 +9,21 @@
 
 #include <stdint.h>
 
+// hopping state for one channel map and access address
+typedef struct
+{
+    uint64_t chanMap;
+    uint8_t numUsedChannels;
+    uint8_t remapping_table[37];
+    uint16_t channelIdentifier;
+} CSA2_Context;
+
+// connection hopping, using internal context
 void csa2_computeMapping(uint32_t accessAddress, uint64_t map);
 uint8_t csa2_computeChannel(uint32_t connEventCounter);
 
+// hopping with caller provided context (eg. periodic advertising trains)
+void csa2_initContext(CSA2_Context *ctx, uint32_t accessAddress, uint64_t map);
+uint8_t csa2_contextChannel(const CSA2_Context *ctx, uint16_t eventCounter);
+
 #endif
@@ -21,6 +21,7 @@ void dprintf(const char *fmt, ...)
     frame.phy = PHY_1M;
     frame.direction = 0;
     frame.eventCtr = 0;
+    frame.connIdx = 0;
     frame.pData = (uint8_t *)buf;
 
     va_start (args, fmt);
@@ -0,0 +1,128 @@
+/*
+ * Written by Sultan Qasim Khan
+ * Copyright (c) 2024, NCC Group plc
+ * Released as open source under GPLv3
+ */
+
+#include <string.h>
+#include "drift_pll.h"
+
+// Loop gains as right shifts. Acquisition uses wider bandwidth to converge
+// within a few events, then narrower bandwidth once locked to reject jitter.
+// Both choices give a stable, slightly underdamped loop.
+#define ACQ_ANCHORS     8
+#define ACQ_KP_SHIFT    1
+#define ACQ_KI_SHIFT    3
+#define LOCK_KP_SHIFT   2
+#define LOCK_KI_SHIFT   5
+
+// Once locked, errors far outside normal jitter usually mean we missed the
+// anchor and caught a later packet in the event. Too many in a row means we
+// really lost track, so start acquiring again.
+#define OUTLIER_MIN_TICKS   (40 * 4)
+#define OUTLIER_JITTER_MULT 8
+#define OUTLIER_MAX_RUN     4
+
+static int32_t apply(DriftPLL *p, int32_t corrQ8)
+{
+    int32_t ticks;
+
+    corrQ8 += p->residQ8;
+    ticks = corrQ8 >> 8; // floor
+    p->residQ8 = corrQ8 - ticks * 256;
+
+    return ticks;
+}
+
+void drift_pll_reset(DriftPLL *p)
+{
+    memset(p, 0, sizeof(DriftPLL));
+}
+
+int32_t drift_pll_update(DriftPLL *p, int32_t err)
+{
+    uint32_t absErr;
+    uint32_t kp, ki;
+
+    // keep fixed point math in range, anything this big is reacquired anyway
+    if (err > 1000000)
+        err = 1000000;
+    else if (err < -1000000)
+        err = -1000000;
+    absErr = err < 0 ? -err : err;
+
+    if (p->anchors >= ACQ_ANCHORS)
+    {
+        uint32_t limit = (p->jitterQ4 * OUTLIER_JITTER_MULT) >> 4;
+        if (limit < OUTLIER_MIN_TICKS)
+            limit = OUTLIER_MIN_TICKS;
+
+        if (absErr > limit)
+        {
+            if (++p->outliers < OUTLIER_MAX_RUN)
+                return drift_pll_coast(p);
+
+            // reacquire from scratch, the frequency estimate that lost track
+            // would otherwise keep steering us away under the faster gains
+            p->anchors = 0;
+            p->freqQ8 = 0;
+            p->residQ8 = 0;
+        }
+    }
+
+    if (p->anchors >= ACQ_ANCHORS)
+    {
+        kp = LOCK_KP_SHIFT;
+        ki = LOCK_KI_SHIFT;
+    } else {
+        kp = ACQ_KP_SHIFT;
+        ki = ACQ_KI_SHIFT;
+    }
+
+    if (p->anchors == 0)
+        p->jitterQ4 = absErr << 4;
+    else
+        p->jitterQ4 += ((int32_t)(absErr << 4) - (int32_t)p->jitterQ4) >> 3;
+
+    if (p->anchors < 0xFFFF)
+        p->anchors++;
+    p->missed = 0;
+    p->outliers = 0;
+
+    p->freqQ8 += (err * 256) >> ki;
+    return apply(p, ((err * 256) >> kp) + p->freqQ8);
+}
+
+int32_t drift_pll_coast(DriftPLL *p)
+{
+    if (p->missed < 0xFFFF)
+        p->missed++;
+    return apply(p, p->freqQ8);
+}
+
+void drift_pll_rescale(DriftPLL *p, uint32_t oldIntervalTicks, uint32_t newIntervalTicks)
+{
+    if (!oldIntervalTicks)
+        return;
+    p->freqQ8 = (int32_t)(((int64_t)p->freqQ8 * newIntervalTicks) / oldIntervalTicks);
+}
+
+uint32_t drift_pll_lead(const DriftPLL *p, uint32_t minLead, uint32_t maxLead)
+{
+    uint32_t lead;
+
+    if (p->anchors < ACQ_ANCHORS)
+        return maxLead;
+
+    // margin of four average errors, growing with each missed anchor
+    lead = minLead + ((p->jitterQ4 * 4 * (1 + p->missed)) >> 4);
+
+    return lead < maxLead ? lead : maxLead;
+}
+
+int32_t drift_pll_ppb(const DriftPLL *p, uint32_t intervalTicks)
+{
+    if (!intervalTicks)
+        return 0;
+    return (int32_t)(((int64_t)p->freqQ8 * 1000000000) / ((int64_t)intervalTicks * 256));
+}
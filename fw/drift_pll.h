@@ -0,0 +1,42 @@
+/*
+ * Written by Sultan Qasim Khan
+ * Copyright (c) 2024, NCC Group plc
+ * Released as open source under GPLv3
+ */
+
+#ifndef DRIFT_PLL_H
+#define DRIFT_PLL_H
+
+#include <stdint.h>
+
+// Second order loop tracking a remote clock from anchor point timing errors.
+// All times are in 4 MHz radio ticks.
+typedef struct
+{
+    int32_t freqQ8;     // drift correction per connection event, 1/256 ticks
+    int32_t residQ8;    // fractional ticks not yet applied
+    uint32_t jitterQ4;  // average magnitude of phase error, 1/16 ticks
+    uint16_t anchors;   // anchors accepted since reset (saturating)
+    uint16_t missed;    // consecutive events without an accepted anchor
+    uint16_t outliers;  // consecutive anchors rejected as outliers
+} DriftPLL;
+
+void drift_pll_reset(DriftPLL *p);
+
+// err is measured anchor time minus expected anchor time
+// returns ticks to add to the next event's start time
+int32_t drift_pll_update(DriftPLL *p, int32_t err);
+
+// no anchor seen this event, returns ticks to add to the next event's start time
+int32_t drift_pll_coast(DriftPLL *p);
+
+// connection interval changed, drift per event scales with it
+void drift_pll_rescale(DriftPLL *p, uint32_t oldIntervalTicks, uint32_t newIntervalTicks);
+
+// how early to start listening before the expected anchor
+uint32_t drift_pll_lead(const DriftPLL *p, uint32_t minLead, uint32_t maxLead);
+
+// estimated remote clock drift relative to ours, in parts per billion
+int32_t drift_pll_ppb(const DriftPLL *p, uint32_t intervalTicks);
+
+#endif
@@ -0,0 +1,92 @@
+/*
+ * Written by Sultan Qasim Khan
+ * Copyright (c) 2024, NCC Group plc
+ * Released as open source under GPLv3
+ */
+
+#include <string.h>
+#include "mac_list.h"
+#include "cache_util.h"
+
+// open addressing hash table with linear probing
+// size must be a power of 2, makefile sets it per platform based on SRAM size
+#ifdef MAC_LIST_SIZE
+#define MAC_TABLE_SIZE MAC_LIST_SIZE
+#else
+#define MAC_TABLE_SIZE 128u
+#endif
+#define MAC_TABLE_MASK (MAC_TABLE_SIZE - 1)
+
+#if (MAC_TABLE_SIZE & MAC_TABLE_MASK) != 0
+#error "MAC_TABLE_SIZE must be a power of 2"
+#endif
+
+// keep load factor at or below 3/4 so probe sequences stay short
+#define MAC_LIST_CAPACITY (MAC_TABLE_SIZE - MAC_TABLE_SIZE / 4)
+
+static uint8_t macs[MAC_TABLE_SIZE][6];
+static uint8_t used[MAC_TABLE_SIZE / 8];
+static uint16_t count = 0;
+
+static inline bool slotUsed(uint16_t i)
+{
+    return (used[i >> 3] >> (i & 7)) & 1;
+}
+
+static inline uint16_t hashMac(const uint8_t *mac)
+{
+    return mac_hash(mac) & MAC_TABLE_MASK;
+}
+
+void mac_list_clear(void)
+{
+    memset(used, 0, sizeof(used));
+    count = 0;
+}
+
+bool mac_list_add(const uint8_t *mac)
+{
+    uint16_t i = hashMac(mac);
+
+    while (slotUsed(i))
+    {
+        if (memcmp(macs[i], mac, 6) == 0)
+            return true; // already present
+        i = (i + 1) & MAC_TABLE_MASK;
+    }
+
+    if (count >= MAC_LIST_CAPACITY)
+        return false;
+
+    // fill slot before marking it used, since lookups run in radio callbacks
+    memcpy(macs[i], mac, 6);
+    used[i >> 3] |= 1 << (i & 7);
+    count++;
+
+    return true;
+}
+
+bool mac_list_contains(const uint8_t *mac)
+{
+    uint16_t i = hashMac(mac);
+
+    // load factor limit guarantees an empty slot terminates the probe
+    while (slotUsed(i))
+    {
+        if (memcmp(macs[i], mac, 6) == 0)
+            return true;
+        i = (i + 1) & MAC_TABLE_MASK;
+    }
+
+    return false;
+}
+
+uint16_t mac_list_count(void)
+{
+    return count;
+}
+
+uint16_t mac_list_capacity(void)
+{
+    return MAC_LIST_CAPACITY;
+}
@@ -0,0 +1,28 @@
+/*
+ * Written by Sultan Qasim Khan
+ * Copyright (c) 2024, NCC Group plc
+ * Released as open source under GPLv3
+ */
+
+#ifndef MAC_LIST_H
+#define MAC_LIST_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// empty the list
+void mac_list_clear(void);
+
+// add a MAC to the list, returns false if the list is full
+bool mac_list_add(const uint8_t *mac);
+
+// returns true if MAC is in the list
+bool mac_list_contains(const uint8_t *mac);
+
+// number of MACs in the list
+uint16_t mac_list_count(void);
+
+// most MACs the list can hold
+uint16_t mac_list_capacity(void);
+
+#endif
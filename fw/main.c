@@ -19,6 +19,7 @@
 #include "CommandTask.h"
 #include "DelayHopTrigger.h"
 #include "DelayStopTrigger.h"
+#include "RatTime.h"
 
 int main(void)
 {
@@ -32,6 +33,7 @@ int main(void)
 
     DelayHopTrigger_init();
     DelayStopTrigger_init();
+    RatTime_init();
 
     /* Start BIOS */
     BIOS_start();
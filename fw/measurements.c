@@ -18,6 +18,7 @@ static void reportMeasurement(uint8_t *buf, uint8_t len)
     frame.pData = buf;
     frame.length = len;
     frame.eventCtr = 0;
+    frame.connIdx = 0;
 
     // Does thread safe copying into queue
     indicatePacket(&frame);
@@ -30,7 +31,17 @@ enum MeasurementTypes
     MEASTYPE_ADVHOP,
     MEASTYPE_WINOFFSET,
     MEASTYPE_DELTAINSTANT,
-    MEASTYPE_VERSION
+    MEASTYPE_VERSION,
+    MEASTYPE_TXBATCH,
+    MEASTYPE_DROPS,
+    MEASTYPE_COUNTERS,
+    MEASTYPE_DEDUP,
+    MEASTYPE_AESBENCH,
+    MEASTYPE_HOPLAT,
+    MEASTYPE_DRIFT,
+    MEASTYPE_CONN,
+    MEASTYPE_TRIGJITTER,
+    MEASTYPE_MACLIST
 };
 
 void reportMeasInterval(uint16_t interval)
@@ -96,7 +107,145 @@ void reportVersion()
     buf[1] = 1; // major version
     buf[2] = 10; // minor version
     buf[3] = 0; // revision
-    buf[4] = 0; // API level
+    buf[4] = 2; // API level
+
+    reportMeasurement(buf, sizeof(buf));
+}
+
+void reportMeasTxBatch(uint32_t batches, uint32_t frames, uint16_t maxBatch)
+{
+    uint8_t buf[11];
+
+    buf[0] = MEASTYPE_TXBATCH;
+    memcpy(buf + 1, &batches, sizeof(uint32_t));
+    memcpy(buf + 5, &frames, sizeof(uint32_t));
+    memcpy(buf + 9, &maxBatch, sizeof(uint16_t));
+
+    reportMeasurement(buf, sizeof(buf));
+}
+
+void reportMeasDrops(uint32_t queued, uint32_t queueFull, uint32_t oversize, uint32_t filtered)
+{
+    uint8_t buf[17];
+
+    buf[0] = MEASTYPE_DROPS;
+    memcpy(buf + 1, &queued, sizeof(uint32_t));
+    memcpy(buf + 5, &queueFull, sizeof(uint32_t));
+    memcpy(buf + 9, &oversize, sizeof(uint32_t));
+    memcpy(buf + 13, &filtered, sizeof(uint32_t));
+
+    reportMeasurement(buf, sizeof(buf));
+}
+
+void reportMeasCounters(uint32_t radioTime, uint32_t pktDrops, const PerfCounters *perf)
+{
+    uint8_t buf[1 + 2*sizeof(uint32_t) + sizeof(PerfCounters)];
+
+    buf[0] = MEASTYPE_COUNTERS;
+    memcpy(buf + 1, &radioTime, sizeof(uint32_t));
+    memcpy(buf + 5, &pktDrops, sizeof(uint32_t));
+    memcpy(buf + 9, perf, sizeof(PerfCounters));
+
+    reportMeasurement(buf, sizeof(buf));
+}
+
+void reportMeasDedup(const uint8_t *advA, uint8_t hdr, uint32_t hash, uint16_t count,
+        int8_t rssiMin, int8_t rssiMax)
+{
+    uint8_t buf[16];
+
+    buf[0] = MEASTYPE_DEDUP;
+    buf[1] = hdr;
+    memcpy(buf + 2, advA, 6);
+    memcpy(buf + 8, &hash, sizeof(uint32_t));
+    memcpy(buf + 12, &count, sizeof(uint16_t));
+    buf[14] = (uint8_t)rssiMin;
+    buf[15] = (uint8_t)rssiMax;
+
+    reportMeasurement(buf, sizeof(buf));
+}
+
+void reportMeasAesBench(uint16_t blocks, uint32_t fastTicks, uint32_t refTicks,
+        uint16_t mismatches)
+{
+    uint8_t buf[13];
+
+    buf[0] = MEASTYPE_AESBENCH;
+    memcpy(buf + 1, &blocks, sizeof(uint16_t));
+    memcpy(buf + 3, &fastTicks, sizeof(uint32_t));
+    memcpy(buf + 7, &refTicks, sizeof(uint32_t));
+    memcpy(buf + 11, &mismatches, sizeof(uint16_t));
+
+    reportMeasurement(buf, sizeof(buf));
+}
+
+void reportMeasHopLatency(uint16_t bucketUs, const uint32_t *hist, uint8_t numBuckets)
+{
+    uint8_t buf[3 + 32*sizeof(uint32_t)];
+
+    if (numBuckets > 32)
+        numBuckets = 32;
+
+    buf[0] = MEASTYPE_HOPLAT;
+    memcpy(buf + 1, &bucketUs, sizeof(uint16_t));
+    memcpy(buf + 3, hist, numBuckets*sizeof(uint32_t));
+
+    reportMeasurement(buf, 3 + numBuckets*sizeof(uint32_t));
+}
+
+void reportMeasDrift(int32_t driftPpb, uint32_t leadTicks, uint32_t jitterQ4)
+{
+    uint8_t buf[9];
+    uint16_t lead16 = leadTicks > 0xFFFF ? 0xFFFF : leadTicks;
+    uint16_t jitter16 = jitterQ4 > 0xFFFF ? 0xFFFF : jitterQ4;
+
+    buf[0] = MEASTYPE_DRIFT;
+    memcpy(buf + 1, &driftPpb, sizeof(int32_t));
+    memcpy(buf + 5, &lead16, sizeof(uint16_t));
+    memcpy(buf + 7, &jitter16, sizeof(uint16_t));
+
+    reportMeasurement(buf, sizeof(buf));
+}
+
+void reportMeasConn(const ConnContext *c, uint8_t reason)
+{
+    uint8_t buf[29];
+    uint16_t interval = c->intervalTicks / 5000;
+
+    buf[0] = MEASTYPE_CONN;
+    buf[1] = c->idx;
+    buf[2] = reason;
+    memcpy(buf + 3, &c->aa, sizeof(uint32_t));
+    memcpy(buf + 7, &c->crcInit, sizeof(uint32_t));
+    memcpy(buf + 11, &interval, sizeof(uint16_t));
+    memcpy(buf + 13, &c->events, sizeof(uint32_t));
+    memcpy(buf + 17, &c->anchors, sizeof(uint32_t));
+    memcpy(buf + 21, &c->skipped, sizeof(uint32_t));
+    memcpy(buf + 25, &c->collisions, sizeof(uint32_t));
+
+    reportMeasurement(buf, sizeof(buf));
+}
+
+void reportMeasTrigJitter(uint8_t kind, uint32_t scheduled, uint32_t actual)
+{
+    uint8_t buf[10];
+
+    buf[0] = MEASTYPE_TRIGJITTER;
+    buf[1] = kind;
+    memcpy(buf + 2, &scheduled, sizeof(uint32_t));
+    memcpy(buf + 6, &actual, sizeof(uint32_t));
+
+    reportMeasurement(buf, sizeof(buf));
+}
+
+void reportMeasMacList(uint16_t count, uint16_t capacity, uint16_t rejected)
+{
+    uint8_t buf[7];
+
+    buf[0] = MEASTYPE_MACLIST;
+    memcpy(buf + 1, &count, sizeof(uint16_t));
+    memcpy(buf + 3, &capacity, sizeof(uint16_t));
+    memcpy(buf + 5, &rejected, sizeof(uint16_t));
 
     reportMeasurement(buf, sizeof(buf));
 }
@@ -5,6 +5,8 @@
  */
 
 #include <stdint.h>
+#include "perf_counters.h"
+#include "conn_sched.h"
 
 void reportMeasInterval(uint16_t interval);
 void reportMeasChanMap(uint64_t map);
@@ -12,3 +14,19 @@ void reportMeasAdvHop(uint32_t hop_us);
 void reportMeasWinOffset(uint16_t offset);
 void reportMeasDeltaInstant(uint16_t delta);
 void reportVersion(void);
+void reportMeasTxBatch(uint32_t batches, uint32_t frames, uint16_t maxBatch);
+void reportMeasDrops(uint32_t queued, uint32_t queueFull, uint32_t oversize, uint32_t filtered);
+void reportMeasCounters(uint32_t radioTime, uint32_t pktDrops, const PerfCounters *perf);
+void reportMeasDedup(const uint8_t *advA, uint8_t hdr, uint32_t hash, uint16_t count,
+        int8_t rssiMin, int8_t rssiMax);
+void reportMeasAesBench(uint16_t blocks, uint32_t fastTicks, uint32_t refTicks,
+        uint16_t mismatches);
+void reportMeasHopLatency(uint16_t bucketUs, const uint32_t *hist, uint8_t numBuckets);
+void reportMeasDrift(int32_t driftPpb, uint32_t leadTicks, uint32_t jitterQ4);
+void reportMeasConn(const ConnContext *c, uint8_t reason);
+void reportMeasMacList(uint16_t count, uint16_t capacity, uint16_t rejected);
+
+// timed radio triggers, for reportMeasTrigJitter
+#define TRIG_HOP    0
+#define TRIG_STOP   1
+void reportMeasTrigJitter(uint8_t kind, uint32_t scheduled, uint32_t actual);
@@ -5,14 +5,22 @@
  */
 
 #include <stdbool.h>
+#include <string.h>
 #include <ti/drivers/UART2.h>
 #include "ti_drivers_config.h"
 #include "ti_sysbios_config.h"
 #include "messenger.h"
 #include "base64.h"
+#include "cobs.h"
+#include "perf_counters.h"
 
 UART2_Handle uart;
 
+// Host to sniffer messages may use either framing at any time: binary frames
+// start with a zero delimiter, which can never begin a base64 message.
+// Sniffer to host framing stays base64 until the host opts in to binary.
+static volatile bool binary_framing = false;
+
 #ifdef UART_1M_BAUD
 static const uint32_t BAUD_RATE = 921600;
 #else
@@ -51,6 +59,74 @@ static void _recv_crlf()
     }
 }
 
+// keep doing small inefficient reads till we hit a zero delimiter
+static void _recv_zero()
+{
+    uint8_t b = 0xFF;
+    size_t bytes_read;
+
+    while (b != 0)
+        UART2_read(uart, &b, 1, &bytes_read);
+}
+
+// called after the leading zero delimiter of a binary frame was received
+// frame contents are COBS(message || CRC16), terminated by another zero
+static int _recv_cobs(uint8_t *dst_buf)
+{
+    uint32_t enc_len = 0;
+    int dec_len;
+    uint16_t crc;
+    uint8_t b;
+    size_t bytes_read;
+
+    static uint8_t cobs_buf[COBS_MAX_ENC_LEN(MESSAGE_MAX + 2)];
+
+    while (1)
+    {
+        UART2_readTimeout(uart, &b, 1, &bytes_read, 20000 / Clock_tickPeriod_D);
+        if (bytes_read < 1)
+        {
+            // message came too slow, truncated
+            return -21;
+        }
+
+        if (b == 0)
+        {
+            // tolerate repeated delimiters between frames
+            if (enc_len == 0)
+                continue;
+            break;
+        }
+
+        if (enc_len == sizeof(cobs_buf))
+        {
+            // too big or some sync issue
+            _recv_zero();
+            return -22;
+        }
+        cobs_buf[enc_len++] = b;
+    }
+
+    // decoding in place is safe since output never overtakes input
+    dec_len = cobs_decode(cobs_buf, cobs_buf, enc_len);
+    if (dec_len < 3 || dec_len > MESSAGE_MAX + 2)
+    {
+        // malformed data
+        return -23;
+    }
+
+    dec_len -= 2;
+    crc = cobs_buf[dec_len] | (cobs_buf[dec_len + 1] << 8);
+    if (crc != crc16_ccitt(cobs_buf, dec_len))
+    {
+        // corrupted data
+        return -24;
+    }
+
+    memcpy(dst_buf, cobs_buf, dec_len);
+    return dec_len;
+}
+
 // this function is NOT reentrant!
 int messenger_recv(uint8_t *dst_buf)
 {
@@ -64,6 +140,8 @@ int messenger_recv(uint8_t *dst_buf)
     // first byte of b64 decoded data indicates number of 4 byte chunks
     // read 2 extra bytes for CRLF
     UART2_read(uart, b64_buf, 1, &bytes_read);
+    if (b64_buf[0] == 0)
+        return _recv_cobs(dst_buf);
     UART2_readTimeout(uart, b64_buf + 1, 5, &bytes_read,
             5000 / Clock_tickPeriod_D);
     if (bytes_read < 5)
@@ -124,26 +202,59 @@ int messenger_recv(uint8_t *dst_buf)
     return dec_len;
 }
 
-void messenger_send(const uint8_t *src_buf, unsigned src_len)
+void messenger_write(const uint8_t *buf, unsigned len)
 {
-    uint32_t enc_len, bytes_remaining, bytes_sent;
+    uint32_t bytes_sent = 0;
 
-    // 2 bytes for CRLF
-    static uint8_t b64_buf[((MESSAGE_MAX * 4) / 3) + 2];
-
-    enc_len = base64_encode(b64_buf, src_buf, src_len);
-    b64_buf[enc_len] = '\r';
-    b64_buf[enc_len + 1] = '\n';
+    atomic_fetch_add(&g_perf.uartBytes, len);
 
-    bytes_remaining = enc_len + 2; // two byte CRLF
-    bytes_sent = 0;
-    while (bytes_remaining)
+    while (len)
     {
         // sometimes, even in blocking mode, UART_write returns before the
         // complete buffer was sent, due to some queues being full
         size_t sent;
-        UART2_write(uart, b64_buf + bytes_sent, bytes_remaining, &sent);
-        bytes_remaining -= sent;
+        UART2_write(uart, buf + bytes_sent, len, &sent);
+        len -= sent;
         bytes_sent += sent;
     }
 }
+
+static unsigned _encode_cobs(uint8_t *dst_buf, const uint8_t *src_buf, unsigned src_len)
+{
+    COBS_Encoder enc;
+    uint32_t enc_len;
+    uint16_t crc;
+    uint8_t crc_bytes[2];
+
+    crc = crc16_ccitt(src_buf, src_len);
+    crc_bytes[0] = crc & 0xFF;
+    crc_bytes[1] = crc >> 8;
+
+    // encode the CRC trailer as part of the same frame without copying src
+    cobs_encode_begin(&enc, dst_buf);
+    cobs_encode_update(&enc, src_buf, src_len);
+    cobs_encode_update(&enc, crc_bytes, 2);
+    enc_len = cobs_encode_end(&enc);
+    dst_buf[enc_len] = 0; // delimiter
+
+    return enc_len + 1;
+}
+
+unsigned messenger_encode(uint8_t *dst_buf, const uint8_t *src_buf, unsigned src_len)
+{
+    uint32_t enc_len;
+
+    if (binary_framing)
+        return _encode_cobs(dst_buf, src_buf, src_len);
+
+    enc_len = base64_encode(dst_buf, src_buf, src_len);
+    dst_buf[enc_len] = '\r';
+    dst_buf[enc_len + 1] = '\n';
+
+    return enc_len + 2; // two byte CRLF
+}
+
+void messenger_set_binary(bool enable)
+{
+    binary_framing = enable;
+}
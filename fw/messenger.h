@@ -7,18 +7,33 @@
 #ifndef MESSENGER_H
 #define MESSENGER_H
 
+#include <stdint.h>
+#include <stdbool.h>
+
 // 300 byte message length limit
 #define MESSAGE_MAX 300
 
+// worst case encoded message size (base64 with CRLF exceeds COBS framing)
+#define MESSENGER_ENC_MAX ((((MESSAGE_MAX + 2) / 3) * 4) + 2)
+
 // message types sent by sniffer
 #define MESSAGE_BLEFRAME 0x10
 #define MESSAGE_DEBUG 0x11
 #define MESSAGE_MARKER 0x12
 #define MESSAGE_STATE 0x13
 #define MESSAGE_MEASURE 0x14
+#define MESSAGE_BLEFRAME_EXT 0x15
+#define MESSAGE_MARKER_EXT 0x16
 
 int messenger_init();
 int messenger_recv(uint8_t *dst_buf);
-void messenger_send(const uint8_t *src_buf, unsigned src_len);
+
+// encode a message into dst_buf (MESSENGER_ENC_MAX bytes), returns encoded length
+// pass one or more concatenated encoded messages to messenger_write
+unsigned messenger_encode(uint8_t *dst_buf, const uint8_t *src_buf, unsigned src_len);
+void messenger_write(const uint8_t *buf, unsigned len);
+
+// select base64+CRLF (default) or COBS+CRC16 framing for sent messages
+void messenger_set_binary(bool enable);
 
 #endif
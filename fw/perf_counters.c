@@ -0,0 +1,18 @@
+/*
+ * Written by Sultan Qasim Khan
+ * Copyright (c) 2024, NCC Group plc
+ * Released as open source under GPLv3
+ */
+
+#include <ti/drivers/rf/RF.h>
+
+#include "perf_counters.h"
+#include "measurements.h"
+#include "PacketTask.h"
+
+PerfCounters g_perf;
+
+void reportPerfCounters(void)
+{
+    reportMeasCounters(RF_getCurrentTime(), packetsDropped(), &g_perf);
+}
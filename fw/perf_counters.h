@@ -0,0 +1,38 @@
+/*
+ * Written by Sultan Qasim Khan
+ * Copyright (c) 2024, NCC Group plc
+ * Released as open source under GPLv3
+ */
+
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+// Counters are written from both task and RF callback contexts, so always
+// update them with atomic_fetch_add. rxBacklogMax only has the RF callback
+// as a writer. Counters are free running and wrap; the host computes rates
+// from deltas.
+typedef struct
+{
+    atomic_uint rxFrames[40];  // frames received per channel
+    atomic_uint crcErrors;     // frames received with bad CRC
+    atomic_uint rxOverflows;   // RF core receive queue full events
+    atomic_uint uartBytes;     // encoded bytes written to UART
+    atomic_uint commands;      // host commands parsed
+    atomic_uint hops;          // connection event and advertising channel hops
+    atomic_uint missedAnchors; // connection events with no anchor packet seen
+    atomic_uint rpaLookups;    // RPAs checked against the IRK table
+    atomic_uint rpaCacheHits;  // RPA lookups resolved from cache without AES
+    atomic_uint auxSchedMisses; // aux advertisements dropped by full scheduler
+    atomic_uint rxBufFull;     // packets the RF core discarded with no free RX entry
+    atomic_uint rxBacklogMax;  // most RX entries found finished in one callback
+} PerfCounters;
+
+extern PerfCounters g_perf;
+
+// send all counters (plus PacketTask drops and current radio time) to host
+void reportPerfCounters(void);
+
+#endif
@@ -8,11 +8,29 @@
 #include <stdint.h>
 #include <rpa_resolver.h>
 #include <sw_aes128.h>
+#include <perf_counters.h>
 
-static uint8_t last_irk[16] = {0};
-static uint8_t last_roundKeys[176] = {0};
-static uint32_t last_prand;
-static uint32_t last_hash;
+// cache size must be a power of 2
+#define RPA_CACHE_BITS 5
+#define RPA_CACHE_SIZE (1 << RPA_CACHE_BITS)
+
+#define CACHE_EMPTY     -2
+#define CACHE_NO_MATCH  -1
+
+typedef struct
+{
+    uint32_t prand;
+    uint32_t hash;
+    int8_t irkIdx; // CACHE_EMPTY, CACHE_NO_MATCH, or IRK table index
+} RpaCacheEntry;
+
+// round keys are precomputed when IRKs are added
+static uint8_t roundKeys[RPA_MAX_IRKS][AES_ROUND_KEY_SIZE];
+static volatile uint8_t numIrks = 0;
+
+// recent resolutions, so repeated advertisements from an RPA skip AES
+// zeroed entries never hit, since every RPA has a nonzero prand
+static RpaCacheEntry cache[RPA_CACHE_SIZE];
 
 /* On Android, keys can be found in /data/misc/bluedroid/bt_config.conf
  * The LE_LOCAL_KEY_IRK is the device's own IRK (LSB first)
@@ -34,7 +52,7 @@ static uint32_t last_hash;
  * Computed hash matches hash portion of RPA, so we have a match
  */
 
-static uint32_t BLE_ah(const void *irk, uint32_t prand)
+static uint32_t BLE_ah(const uint8_t *rk, uint32_t prand)
 {
     uint8_t r_[16] = {0};
     uint8_t res[16];
@@ -47,43 +65,75 @@ static uint32_t BLE_ah(const void *irk, uint32_t prand)
 
     // I use software AES to avoid changing global state of hardware and to
     // minimize the overhead of setting up hardware for one-off operations
-    if (memcmp(irk, last_irk, 16) != 0)
-    {
-        aes_key_schedule_128(irk, last_roundKeys);
-        memcpy(last_irk, irk, 16);
-        last_prand = 0xFFFFFFFF; // invalidate cached hash
-    } else if (prand == last_prand) {
-        return last_hash;
-    }
-
-    aes_encrypt_128(last_roundKeys, r_, res);
+    aes_encrypt_128(rk, r_, res);
 
     // hash is 3 LSB of the big endian AES result
     return res[15] | (res[14] << 8) | (res[13] << 16);
 }
 
-// returns true on RPA matching IRK
-bool rpa_match(const void *irk, const void *rpa)
+static void cacheInvalidate(void)
+{
+    int i;
+
+    for (i = 0; i < RPA_CACHE_SIZE; i++)
+        cache[i].irkIdx = CACHE_EMPTY;
+}
+
+void rpa_irks_clear(void)
+{
+    numIrks = 0;
+    cacheInvalidate();
+}
+
+bool rpa_irk_add(const void *irk)
+{
+    if (numIrks >= RPA_MAX_IRKS)
+        return false;
+
+    aes_key_schedule_128(irk, roundKeys[numIrks]);
+    numIrks++;
+
+    // cached non-matches may now match the new IRK
+    cacheInvalidate();
+
+    return true;
+}
+
+int rpa_resolve(const void *rpa)
 {
-    bool valid;
     const uint8_t *rpa8 = (const uint8_t *)rpa;
+    RpaCacheEntry *e;
     uint32_t hash = 0;
     uint32_t prand = 0;
+    int i, n;
 
     // make sure it's an RPA
     if ((rpa8[5] & 0xC0) != 0x40)
-        return false;
+        return -1;
 
     memcpy(&hash, rpa8, 3);
     memcpy(&prand, rpa8 + 3, 3);
 
-    valid = (hash == BLE_ah(irk, prand));
+    atomic_fetch_add(&g_perf.rpaLookups, 1);
+
+    // prand is random, so Fibonacci hashing it spreads RPAs across the cache
+    e = &cache[((prand ^ hash) * 2654435761u) >> (32 - RPA_CACHE_BITS)];
+    if (e->irkIdx != CACHE_EMPTY && e->prand == prand && e->hash == hash)
+    {
+        atomic_fetch_add(&g_perf.rpaCacheHits, 1);
+        return e->irkIdx;
+    }
 
-    if (valid)
+    n = numIrks;
+    for (i = 0; i < n; i++)
     {
-        last_prand = prand;
-        last_hash = hash;
+        if (hash == BLE_ah(roundKeys[i], prand))
+            break;
     }
 
-    return valid;
+    e->prand = prand;
+    e->hash = hash;
+    e->irkIdx = (i < n) ? i : CACHE_NO_MATCH;
+
+    return e->irkIdx;
 }
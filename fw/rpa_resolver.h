@@ -9,7 +9,15 @@
 
 #include <stdbool.h>
 
-// returns true on RPA matching IRK
-bool rpa_match(const void *irk, const void *rpa);
+#define RPA_MAX_IRKS 8
+
+// remove all IRKs and invalidate cached resolutions
+void rpa_irks_clear(void);
+
+// add an IRK (LSB first), returns false if the table is full
+bool rpa_irk_add(const void *irk);
+
+// returns index of the IRK the RPA resolves to, or -1 if none match
+int rpa_resolve(const void *rpa);
 
 #endif
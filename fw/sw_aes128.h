@@ -55,6 +55,12 @@ void aes_key_schedule_128(const uint8_t *key, uint8_t *roundkeys);
  */
 void aes_encrypt_128(const uint8_t *roundkeys, const uint8_t *plaintext, uint8_t *ciphertext);
 
+/**
+ * @purpose:            Reference byte oriented encryption, slower than aes_encrypt_128
+ *                      but kept for cross-checking it. Same parameters as aes_encrypt_128.
+ */
+void aes_encrypt_128_ref(const uint8_t *roundkeys, const uint8_t *plaintext, uint8_t *ciphertext);
+
 /**
  * @purpose:            Decryption. The length of plain and cipher should be one block (16 bytes).
  *                      The ciphertext and plaintext may point to the same memory
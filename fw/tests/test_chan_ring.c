@@ -0,0 +1,206 @@
+/*
+ * Written by Sultan Qasim Khan
+ * Copyright (c) 2024, NCC Group plc
+ * Released as open source under GPLv3
+ */
+
+// Host test of the connection event channel lookahead ring. Follows a
+// connection for all 65536 event counters, the way RadioTask does, and checks
+// every channel against reference CSA #1 and CSA #2 computations.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "chan_ring.h"
+#include "csa1.h"
+#include "csa2.h"
+
+#define ALL_CHANS 0x1FFFFFFFFFULL
+#define NUM_EVENTS 0x10000
+
+static int failures;
+
+// CSA #1 as written in the spec, unmapped channel advances by hop every event
+static uint8_t ref_csa1(uint64_t map, uint8_t unmapped)
+{
+    uint8_t remap[37], numUsed = 0, i;
+
+    if (map & (1ULL << unmapped))
+        return unmapped;
+    for (i = 0; i < 37; i++)
+        if (map & (1ULL << i))
+            remap[numUsed++] = i;
+    return remap[unmapped % numUsed];
+}
+
+static void check_csa2_samples(void)
+{
+    // Core spec Vol 6 Part C 3.1 and 3.2 sample data
+    static const uint8_t allChans[] = {25, 20, 6, 21};
+    static const uint8_t nineChans[][2] = {{6, 23}, {7, 9}, {8, 34}};
+    uint64_t nineMap = (1ULL << 9) | (1ULL << 10) | (1ULL << 21) | (1ULL << 22) |
+        (1ULL << 23) | (1ULL << 33) | (1ULL << 34) | (1ULL << 35) | (1ULL << 36);
+    CSA2_Context ctx;
+    int i;
+
+    csa2_initContext(&ctx, 0x8E89BED6, ALL_CHANS);
+    for (i = 0; i < 4; i++)
+    {
+        if (csa2_contextChannel(&ctx, i) != allChans[i])
+        {
+            printf("FAIL: CSA #2 sample 1 counter %d\n", i);
+            failures++;
+        }
+    }
+
+    csa2_initContext(&ctx, 0x8E89BED6, nineMap);
+    for (i = 0; i < 3; i++)
+    {
+        if (csa2_contextChannel(&ctx, nineChans[i][0]) != nineChans[i][1])
+        {
+            printf("FAIL: CSA #2 sample 2 counter %d\n", nineChans[i][0]);
+            failures++;
+        }
+    }
+}
+
+// Follow a connection starting at event 0, switching to the next map in maps
+// every mapPeriod events (0 for never). Refills the ring as RadioTask does:
+// two entries after every event, and the whole ring before some events.
+static void applyMap(bool csa2, uint32_t aa, uint64_t map, CSA2_Context *ref2)
+{
+    if (csa2)
+        csa2_computeMapping(aa, map);
+    else
+        csa1_computeMapping(map);
+    csa2_initContext(ref2, aa, map);
+}
+
+// Follow a connection starting at event 0, switching to the next map in maps
+// every mapPeriod events (0 for never). Hops and refills the ring as RadioTask
+// does: map updates and two new entries after every event, and the whole ring
+// before some events.
+static void run(const char *name, bool csa2, uint8_t hop, uint32_t aa,
+        const uint64_t *maps, int numMaps, uint32_t mapPeriod)
+{
+    ChanRing ring;
+    CSA2_Context ref2;
+    uint32_t connEventCount = 0, ev, hits = 0, errors = 0;
+    uint8_t curUnmapped = hop, refUnmapped = hop;
+    int mapIdx = 0;
+
+    // handleConnReq
+    applyMap(csa2, aa, maps[0], &ref2);
+    chan_ring_reset(&ring, connEventCount, curUnmapped);
+
+    for (ev = 0; ev < NUM_EVENTS; ev++)
+    {
+        uint8_t chan, expect;
+
+        if (chan_ring_lookup(&ring, connEventCount, &chan))
+            hits++;
+        else if (csa2)
+            chan = csa2_computeChannel(connEventCount);
+        else
+            chan = csa1_computeChannel(curUnmapped);
+
+        expect = csa2 ? csa2_contextChannel(&ref2, ev & 0xFFFF) :
+            ref_csa1(maps[mapIdx], refUnmapped);
+        if (chan != expect && errors++ < 5)
+            printf("FAIL: %s event %u: got %u, expected %u\n", name, ev, chan, expect);
+
+        // afterConnEvent
+        curUnmapped = (curUnmapped + hop) % 37;
+        refUnmapped = (refUnmapped + hop) % 37;
+        connEventCount++;
+        if (mapPeriod && connEventCount % mapPeriod == 0)
+        {
+            // rconf_dequeue and computeMaps at the instant
+            mapIdx = (mapIdx + 1) % numMaps;
+            applyMap(csa2, aa, maps[mapIdx], &ref2);
+            chan_ring_reset(&ring, connEventCount, curUnmapped);
+        }
+        chan_ring_fill(&ring, connEventCount, curUnmapped, hop, csa2, 2);
+
+        // idle refill before CENTRAL/PERIPHERAL events
+        if (ev % 3 == 0)
+            chan_ring_fill(&ring, connEventCount, curUnmapped, hop, csa2, CHAN_LOOKAHEAD);
+    }
+
+    // the ring should serve every event but the first, or the test proves little
+    if (hits != NUM_EVENTS - 1)
+    {
+        printf("FAIL: %s: ring only covered %u events\n", name, hits);
+        errors++;
+    }
+
+    printf("%s %s (%u events, %u from ring)\n", errors ? "FAIL" : "ok  ", name, ev, hits);
+    if (errors)
+        failures++;
+}
+
+static uint64_t random_map(void)
+{
+    uint64_t map;
+
+    // at least two channels must be used
+    do {
+        map = (((uint64_t)rand() << 31) ^ rand()) & ALL_CHANS;
+    } while (__builtin_popcountll(map) < 2);
+
+    return map;
+}
+
+int main(void)
+{
+    static const uint64_t fixedMaps[] = {
+        ALL_CHANS,
+        (1ULL << 9) | (1ULL << 10) | (1ULL << 21) | (1ULL << 22) | (1ULL << 23) |
+            (1ULL << 33) | (1ULL << 34) | (1ULL << 35) | (1ULL << 36),
+        (1ULL << 0) | (1ULL << 36),
+        0x00000FFFFFULL,
+    };
+    uint64_t randMaps[8];
+    int i, csa2;
+
+    srand(1);
+    for (i = 0; i < 8; i++)
+        randMaps[i] = random_map();
+
+    check_csa2_samples();
+
+    for (csa2 = 0; csa2 < 2; csa2++)
+    {
+        static const uint8_t hops[] = {5, 11, 16};
+        const char *alg = csa2 ? "CSA #2" : "CSA #1";
+        char name[64];
+
+        for (i = 0; i < 4; i++)
+        {
+            snprintf(name, sizeof(name), "%s fixed map %d", alg, i);
+            run(name, csa2, hops[i % 3], 0x8E89BED6, fixedMaps + i, 1, 0);
+        }
+
+        for (i = 0; i < 3; i++)
+        {
+            snprintf(name, sizeof(name), "%s random map, hop %d", alg, hops[i]);
+            run(name, csa2, hops[i], 0x50657A13 + i, randMaps + i, 1, 0);
+        }
+
+        snprintf(name, sizeof(name), "%s map updates every 997 events", alg);
+        run(name, csa2, 7, 0x71764129, randMaps, 8, 997);
+
+        snprintf(name, sizeof(name), "%s map updates every 5 events", alg);
+        run(name, csa2, 9, 0xAF9A8A32, fixedMaps, 4, 5);
+    }
+
+    if (failures)
+    {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    printf("all passed\n");
+    return 0;
+}
@@ -0,0 +1,33 @@
+#!/usr/bin/env python3
+
+# Written by Sultan Qasim Khan
+# Copyright (c) 2024, NCC Group plc
+# Released as open source under GPLv3
+
+import argparse
+from time import time
+from sniffle.sniffle_hw import SniffleHW
+from sniffle.measurements import AesBenchMeasurement
+
+def main():
+    aparse = argparse.ArgumentParser(description="Sniffle firmware software AES benchmark")
+    aparse.add_argument("-s", "--serport", default=None, help="Sniffer serial port name")
+    aparse.add_argument("-n", "--blocks", default=1024, type=int, help="Blocks to encrypt")
+    args = aparse.parse_args()
+
+    hw = SniffleHW(args.serport, timeout=0.1)
+    hw.cmd_aes_bench(args.blocks)
+
+    etime = time() + 2
+    while time() < etime:
+        msg = hw.recv_and_decode(True)
+        if isinstance(msg, AesBenchMeasurement):
+            print(msg)
+            if msg.mismatches:
+                print("Fast AES output differs from reference!")
+            break
+    else:
+        print("Timeout waiting for benchmark result")
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,88 @@
+#!/usr/bin/env python3
+
+# Written by Sultan Qasim Khan
+# Copyright (c) 2024, NCC Group plc
+# Released as open source under GPLv3
+
+# Times packet decoding over a recorded capture, for capture-only use (decode and
+# write pcap) versus full use (decode and format every field). No hardware needed.
+
+import argparse
+from io import BytesIO
+from random import Random
+from time import perf_counter
+from sniffle.pcap import PcapBleReader, PcapBleWriter
+from sniffle.packet_decoder import PacketMessage, DPacketMessage
+from sniffle.decoder_state import SniffleDecoderState
+
+# stand-in for a recording: legacy and extended advertisements, and data packets
+def synth_packets(count):
+    rand = Random(0)
+    pkts = []
+    for i in range(count):
+        kind = i % 4
+        if kind == 0: # ADV_IND
+            body = bytes([0x40, 0]) + rand.randbytes(6 + rand.randrange(31))
+            chan = 37
+        elif kind == 1: # ADV_EXT_IND with AdvA, ADI and AuxPtr
+            ext = bytes([0x0C, 0x19]) + rand.randbytes(11)
+            body = bytes([0x47, len(ext)]) + ext
+            chan = 38
+        elif kind == 2: # AUX_ADV_IND with AdvA and ADI
+            ext = bytes([0x09, 0x09]) + rand.randbytes(8) + rand.randbytes(rand.randrange(40))
+            body = bytes([0x07, len(ext)]) + ext
+            chan = rand.randrange(37)
+        else: # LL data, AA set below
+            body = bytes([0x02]) + bytes([0]) + rand.randbytes(rand.randrange(27))
+            chan = None
+        body = body[:1] + bytes([len(body) - 2]) + body[2:]
+        is_data = chan is None
+        pkts.append(PacketMessage.from_fields(i * 1250, len(body), i, -60, 5 if is_data else chan,
+                0, body, None, False, SniffleDecoderState(is_data)))
+    return pkts
+
+def load_pcap(fname):
+    # keep just what the firmware would have sent, undecoded
+    pkts = []
+    for p in PcapBleReader(fname):
+        pkts.append(PacketMessage.from_fields(0, p.orig_len, p.event, p.rssi, p.chan, p.phy,
+                p.body, p.crc_rev, p.crc_err, SniffleDecoderState(p.aa != 0x8E89BED6),
+                p.data_dir))
+    return pkts
+
+def capture_only(pkts):
+    dstate = SniffleDecoderState()
+    writer = PcapBleWriter(BytesIO())
+    for p in pkts:
+        writer.write_packet_message(DPacketMessage.decode(p, dstate))
+
+def full_decode(pkts):
+    dstate = SniffleDecoderState()
+    for p in pkts:
+        str(DPacketMessage.decode(p, dstate))
+
+def run(name, func, pkts, rounds):
+    best = None
+    for i in range(rounds):
+        t0 = perf_counter()
+        func(pkts)
+        dt = perf_counter() - t0
+        best = dt if best is None or dt < best else best
+    print("%-14s %8d pkts  %7.1f ms  %6.2f us/pkt" % (name, len(pkts), best * 1E3,
+        best * 1E6 / len(pkts)))
+
+def main():
+    aparse = argparse.ArgumentParser(description="Packet decoding benchmark")
+    aparse.add_argument("-i", "--input", default=None,
+            help="PCAP recorded by sniff_receiver (default: synthetic packets)")
+    aparse.add_argument("-n", "--count", default=40000, type=int,
+            help="Synthetic packet count")
+    aparse.add_argument("-r", "--rounds", default=3, type=int, help="Take best of this many runs")
+    args = aparse.parse_args()
+
+    pkts = load_pcap(args.input) if args.input else synth_packets(args.count)
+    run("capture only", capture_only, pkts, args.rounds)
+    run("full decode", full_decode, pkts, args.rounds)
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+
+# Written by Sultan Qasim Khan
+# Copyright (c) 2024, NCC Group plc
+# Released as open source under GPLv3
+
+# Compares host side message parsing throughput of the native and pure Python
+# framing implementations, and the previous per-message decoding, over a
+# synthetic stream of BLE frame messages. No hardware needed.
+
+import argparse
+from base64 import b64encode, b64decode
+from random import Random
+from struct import pack, unpack
+from time import perf_counter
+from sniffle import framing
+from sniffle.cobs import frame_encode, frame_decode
+from sniffle.decoder_state import SniffleDecoderState
+from sniffle.packet_decoder import PacketMessage
+
+def make_stream(count, binary):
+    rand = Random(0)
+    out = []
+    for i in range(count):
+        body = bytes([rand.randrange(7)]) + rand.randbytes(rand.randrange(6, 38))
+        body = body[:1] + bytes([len(body) - 2]) + body[2:]
+        msg = bytes([0x10]) + pack("<LHHbB", i * 625, len(body), 0,
+                -rand.randrange(30, 90), 37 + i % 3) + body
+        msg = bytes([(len(msg) + 3) // 3]) + msg
+        out.append(b'\x00' + frame_encode(msg) if binary else b64encode(msg) + b'\r\n')
+    return b''.join(out)
+
+# what SniffleHW._recv_msg and recv_and_decode did per message before batching
+def legacy(stream, binary):
+    dstate = SniffleDecoderState()
+    delim = b'\x00' if binary else b'\r\n'
+    n = 0
+    for line in stream.split(delim):
+        if not line:
+            continue
+        if binary:
+            data = frame_decode(line)
+        else:
+            b64decode(line[:4])
+            data = b64decode(line)
+        PacketMessage(data[2:], dstate)
+        n += 1
+    return n
+
+def batched(parse, stream, binary, chunk, packets=True):
+    dstate = SniffleDecoderState()
+    buf = bytearray()
+    n = 0
+    for i in range(0, len(stream), chunk):
+        buf += stream[i:i + chunk]
+        msgs, consumed, errors = parse(buf, binary)
+        del buf[:consumed]
+        n += len(msgs)
+        if packets:
+            for mtype, ts, l, event, rssi, chan, body in msgs:
+                PacketMessage.from_header(ts, l, event, rssi, chan, body, dstate)
+    return n
+
+def run(name, func, *args):
+    t0 = perf_counter()
+    n = func(*args)
+    dt = perf_counter() - t0
+    print("%-28s %8d msgs  %7.1f ms  %9.0f msgs/s" % (name, n, dt * 1E3, n / dt))
+
+def main():
+    aparse = argparse.ArgumentParser(description="Host message parsing benchmark")
+    aparse.add_argument("-n", "--count", default=100000, type=int, help="Messages to parse")
+    aparse.add_argument("-b", "--binary", action="store_true", help="Use binary (COBS) framing")
+    aparse.add_argument("-c", "--chunk", default=4096, type=int, help="Bytes per read")
+    args = aparse.parse_args()
+
+    stream = make_stream(args.count, args.binary)
+    print("%d bytes, %s framing, %s native parser" % (len(stream),
+        "binary" if args.binary else "base64", "with" if framing.native else "without"))
+
+    run("legacy per-message", legacy, stream, args.binary)
+    run("python batch + packets", batched, framing.parse_messages_py, stream,
+            args.binary, args.chunk)
+    if framing.native:
+        run("native batch + packets", batched, framing.parse_messages, stream,
+                args.binary, args.chunk)
+
+    # framing alone, without building PacketMessage objects
+    run("python batch parse only", batched, framing.parse_messages_py, stream,
+            args.binary, args.chunk, False)
+    if framing.native:
+        run("native batch parse only", batched, framing.parse_messages, stream,
+                args.binary, args.chunk, False)
+
+if __name__ == "__main__":
+    main()
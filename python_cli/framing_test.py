@@ -0,0 +1,97 @@
+#!/usr/bin/env python3
+
+# Written by Sultan Qasim Khan
+# Copyright (c) 2024, NCC Group plc
+# Released as open source under GPLv3
+
+# Checks that the native and pure Python framing implementations agree on
+# which messages are valid, over a synthetic stream with random corruption.
+# No hardware needed, but the native module must be built first
+# (python3 setup.py build_ext --inplace).
+
+import argparse
+import sys
+from base64 import b64encode
+from random import Random
+from struct import pack
+from sniffle import framing
+from sniffle.cobs import frame_encode
+
+# bytes likely to trip up a decoder: delimiter halves, padding, whitespace,
+# characters just outside the base64 alphabet, and a few valid ones
+NASTY = b'\x00\r\n= \t-_.:@[`{' + b'AZaz09+/'
+
+def make_msg(rand, i):
+    body = bytes([rand.randrange(7)]) + rand.randbytes(rand.randrange(0, 38))
+    body = body[:1] + bytes([max(len(body) - 2, 0)]) + body[2:]
+    msg = bytes([0x10]) + pack("<LHHbB", i * 625, len(body), 0,
+            -rand.randrange(30, 90), rand.randrange(40)) + body
+    return bytes([(len(msg) + 3) // 3]) + msg
+
+def corrupt(rand, frame):
+    frame = bytearray(frame)
+    for _ in range(rand.randrange(1, 4)):
+        op = rand.randrange(4)
+        pos = rand.randrange(len(frame) + 1)
+        if op == 0 and pos < len(frame):
+            frame[pos] = rand.choice(NASTY)
+        elif op == 1 and pos < len(frame):
+            del frame[pos]
+        elif op == 2:
+            frame.insert(pos, rand.choice(NASTY))
+        elif pos < len(frame):
+            frame[pos] ^= 1 << rand.randrange(8)
+    return bytes(frame)
+
+def make_stream(rand, count, binary):
+    out = []
+    for i in range(count):
+        msg = make_msg(rand, i)
+        frame = b'\x00' + frame_encode(msg) if binary else b64encode(msg) + b'\r\n'
+        if rand.random() < 0.3:
+            frame = corrupt(rand, frame)
+        out.append(frame)
+    return b''.join(out)
+
+def parse_all(parse, stream, binary, chunk):
+    buf = bytearray()
+    msgs = []
+    errors = 0
+    for i in range(0, len(stream), chunk):
+        buf += stream[i:i + chunk]
+        m, consumed, e = parse(buf, binary)
+        del buf[:consumed]
+        msgs.extend(m)
+        errors += e
+    return msgs, errors
+
+def main():
+    aparse = argparse.ArgumentParser(description="Native vs Python framing parity test")
+    aparse.add_argument("-n", "--count", type=int, default=2000, help="Messages per stream")
+    aparse.add_argument("-r", "--rounds", type=int, default=20, help="Streams per mode")
+    args = aparse.parse_args()
+
+    if not framing.native:
+        print("Native framing module not built, nothing to compare")
+        return 1
+
+    failures = 0
+    for binary in (False, True):
+        mode = "COBS" if binary else "base64"
+        for r in range(args.rounds):
+            rand = Random(r)
+            stream = make_stream(rand, args.count, binary)
+            chunk = rand.randrange(1, 4096)
+            native = parse_all(framing.parse_messages, stream, binary, chunk)
+            python = parse_all(framing.parse_messages_py, stream, binary, chunk)
+            if native != python:
+                print("%s round %d: native %d msgs %d errors, Python %d msgs %d errors" % (
+                    mode, r, len(native[0]), native[1], len(python[0]), python[1]))
+                failures += 1
+        print("%s: %d rounds done" % (mode, args.rounds))
+
+    print("FAIL" if failures else "PASS")
+    return 1 if failures else 0
+
+if __name__ == "__main__":
+    sys.exit(main())
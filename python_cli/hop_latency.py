@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+
+# Written by Sultan Qasim Khan
+# Copyright (c) 2024, NCC Group plc
+# Released as open source under GPLv3
+
+import argparse
+from time import time, sleep
+from sniffle.sniffle_hw import SniffleHW
+from sniffle.measurements import HopLatencyMeasurement, TrigJitterMeasurement
+
+def read_histogram(hw, reset):
+    hw.cmd_hop_latency(reset)
+    etime = time() + 2
+    while time() < etime:
+        msg = hw.recv_and_decode(True)
+        if isinstance(msg, HopLatencyMeasurement):
+            return msg
+    return None
+
+def collect_jitter(hw, duration):
+    lates = {TrigJitterMeasurement.HOP: [], TrigJitterMeasurement.STOP: []}
+    hw.cmd_trig_jitter(True)
+    etime = time() + duration
+    while time() < etime:
+        msg = hw.recv_and_decode(True)
+        if isinstance(msg, TrigJitterMeasurement) and msg.kind in lates:
+            lates[msg.kind].append(msg.late_us)
+    hw.cmd_trig_jitter(False)
+
+    for kind, name in [(TrigJitterMeasurement.HOP, "Hop"), (TrigJitterMeasurement.STOP, "Stop")]:
+        l = sorted(lates[kind])
+        if not l:
+            print("%s triggers: none fired" % name)
+            continue
+        print("%s triggers: %d, late by min %.2f us, median %.2f us, max %.2f us" % (
+            name, len(l), l[0], l[len(l) // 2], l[-1]))
+
+def main():
+    aparse = argparse.ArgumentParser(description="Sniffle firmware hop latency histogram")
+    aparse.add_argument("-s", "--serport", default=None, help="Sniffer serial port name")
+    aparse.add_argument("-t", "--time", default=0, type=float,
+            help="Clear histogram, then collect for this many seconds (default: read as is)")
+    aparse.add_argument("-j", "--jitter", action="store_true",
+            help="Instead measure timed trigger jitter for --time seconds (default 10)")
+    args = aparse.parse_args()
+
+    hw = SniffleHW(args.serport, timeout=0.1)
+
+    if args.jitter:
+        collect_jitter(hw, args.time if args.time > 0 else 10)
+        return
+
+    if args.time > 0:
+        if read_histogram(hw, True) is None:
+            print("Timeout waiting for histogram")
+            return
+        sleep(args.time)
+
+    msg = read_histogram(hw, False)
+    if msg is None:
+        print("Timeout waiting for histogram")
+        return
+    print(msg)
+    if msg.total():
+        print(msg.histogram())
+
+if __name__ == "__main__":
+    main()
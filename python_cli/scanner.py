@@ -10,18 +10,16 @@ from sniffle.sniffle_hw import make_sniffle_hw, PhyMode, SnifferMode, PacketMess
 from sniffle.packet_decoder import *
 from sniffle.pcap import PcapBleWriter
 from sniffle.advdata.decoder import decode_adv_data
-from sniffle.errors import SourceDone
+from sniffle.pipeline import CapturePipeline
 
 # global variables
 hw = None
+pipeline = None
 pcwriter = None
 advertisers = {}
-done_scan = False
 
 def sigint_handler(sig, frame):
-    global done_scan
-    done_scan = True
-    hw.cancel_recv()
+    pipeline.stop()
 
 class Advertiser:
     def __init__(self):
@@ -76,16 +74,16 @@ def main():
     if not (args.output is None):
         pcwriter = PcapBleWriter(args.output)
 
+    global pipeline
+    pipeline = CapturePipeline(hw)
+
     # trap Ctrl-C
     signal.signal(signal.SIGINT, sigint_handler)
 
     print("Starting scanner. Press CTRL-C to stop scanning and show results.")
 
-    while not done_scan:
-        try:
-            msg = hw.recv_and_decode()
-        except SourceDone:
-            break
+    pipeline.start()
+    for msg in pipeline:
         if isinstance(msg, DebugMessage):
             print(msg)
         elif isinstance(msg, PacketMessage):
@@ -94,6 +92,9 @@ def main():
     # Stop active scanning
     hw.setup_sniffer()
 
+    if pipeline.dropped:
+        print("\n%s" % pipeline)
+
     print("\n\nScan Results:")
     for a in sorted(advertisers.keys(), key=lambda k: advertisers[k].rssi_avg, reverse=True):
         print("="*80)
@@ -136,8 +137,9 @@ def handle_packet(dpkt):
 
     global advertisers
 
-    if isinstance(dpkt, AdvaMessage) or isinstance(dpkt, AdvDirectIndMessage) or (
-            isinstance(dpkt, AdvExtIndMessage) and dpkt.AdvA is not None):
+    # AdvA may be missing from extended or truncated advertisements
+    if isinstance(dpkt, (AdvaMessage, AdvDirectIndMessage, AdvExtIndMessage)) and \
+            dpkt.AdvA is not None:
         adva = str_mac2(dpkt.AdvA, dpkt.TxAdd)
 
         if not adva in advertisers:
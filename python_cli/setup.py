@@ -0,0 +1,15 @@
+# Written by Sultan Qasim Khan
+# Copyright (c) 2024, NCC Group plc
+# Released as open source under GPLv3
+
+# Builds the optional native framing module. The CLI tools run from this
+# directory and fall back to pure Python if it hasn't been built:
+#   python3 setup.py build_ext --inplace
+
+from setuptools import setup, Extension
+
+setup(
+    name="sniffle",
+    packages=["sniffle"],
+    ext_modules=[Extension("sniffle._framing", ["sniffle/_framing.c"], optional=True)]
+)
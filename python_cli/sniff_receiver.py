@@ -5,22 +5,31 @@
 # Released as open source under GPLv3
 
 import argparse, sys
+from threading import Thread
+from time import sleep
 from binascii import unhexlify
 from sniffle.constants import BLE_ADV_AA
 from sniffle.pcap import PcapBleWriter
 from sniffle.sniffle_hw import (make_sniffle_hw, PacketMessage, DebugMessage, StateMessage,
                                 MeasurementMessage, SnifferMode, PhyMode)
+from sniffle.measurements import CountersMeasurement
 from sniffle.packet_decoder import (AdvaMessage, AdvDirectIndMessage, AdvExtIndMessage,
                                     ScanRspMessage, DataMessage, str_mac)
-from sniffle.errors import UsageError, SourceDone
+from sniffle.pipeline import CapturePipeline
+from sniffle.errors import UsageError
 from sniffle.advdata.decoder import decode_adv_data
 
-# global variable to access hardware
+# global variables to access hardware and the capture pipeline reading from it
 hw = None
+pipeline = None
 
 # global variable for pcap writer
 pcwriter = None
 
+# previous firmware counters and host receive stats, for computing rates
+last_counters = None
+last_rx_stats = None
+
 def main():
     aparse = argparse.ArgumentParser(description="Host-side receiver for Sniffle BLE5 sniffer")
     aparse.add_argument("-s", "--serport", default=None, help="Sniffer serial port name")
@@ -31,7 +40,12 @@ def main():
     aparse.add_argument("-r", "--rssi", default=-128, type=int,
             help="Filter packets by minimum RSSI")
     aparse.add_argument("-m", "--mac", default=None, help="Filter packets by advertiser MAC")
-    aparse.add_argument("-i", "--irk", default=None, help="Filter packets by advertiser IRK")
+    aparse.add_argument("-i", "--irk", default=None,
+            help="Filter packets by advertiser IRK (comma separated for several)")
+    aparse.add_argument("--maclist", default=None,
+            help="Filter packets by advertiser MACs listed in file, one per line")
+    aparse.add_argument("--denylist", action="store_true",
+            help="Drop packets from MACs in --maclist instead of allowing them")
     aparse.add_argument("-S", "--string", default=None,
             help="Filter for advertisements containing the specified string")
     aparse.add_argument("-a", "--advonly", action="store_true",
@@ -54,26 +68,54 @@ def main():
             help="Capture packets with CRC errors")
     aparse.add_argument("-d", "--decode", action="store_true",
             help="Decode advertising data")
+    aparse.add_argument("-b", "--binary", action="store_true",
+            help="Use binary UART framing if firmware supports it")
     aparse.add_argument("-o", "--output", default=None, help="PCAP output file name")
+    aparse.add_argument("--stats", action="store_true",
+            help="Print firmware performance counter rates every second")
+    aparse.add_argument("--snaplen", default=0, type=int,
+            help="Truncate captured PDUs to this many bytes (0 for no limit)")
+    aparse.add_argument("--dedup", default=0, type=int,
+            help="Suppress repeated advertisements within this many ms (0 to disable)")
+    aparse.add_argument("--multiconn", action="store_true",
+            help="Also follow connections that start while following one")
     args = aparse.parse_args()
 
     # Sanity check argument combinations
-    targ_specs = bool(args.mac) + bool(args.irk) + bool(args.string)
+    targ_specs = bool(args.mac) + bool(args.irk) + bool(args.string) + bool(args.maclist)
     if args.hop and targ_specs < 1:
         raise UsageError("Primary adv. channel hop requires a target MAC, IRK, or ad string specified!")
     if args.longrange and args.hop:
         # this would be pointless anyway, since long range always uses extended ads
         raise UsageError("Primary ad channel hopping unsupported on long range PHY!")
     if targ_specs > 1:
-        raise UsageError("MAC, IRK, and advertisement string filters are mutually exclusive!")
+        raise UsageError("MAC, MAC list, IRK, and advertisement string filters are mutually exclusive!")
+    if args.denylist and not args.maclist:
+        raise UsageError("Denylist requires a MAC list!")
+    if args.snaplen != 0 and not (2 <= args.snaplen <= 255):
+        raise UsageError("Snaplen must be between 2 and 255 bytes!")
+    if not (0 <= args.dedup <= 65535):
+        raise UsageError("Dedup window must be between 0 and 65535 ms!")
+    if args.multiconn and (args.advonly or args.scan):
+        raise UsageError("Following multiple connections requires connection following!")
     if args.advchan != 40 and args.hop:
         raise UsageError("Don't specify an advertising channel if you want advertising channel hopping!")
 
     global hw
     hw = make_sniffle_hw(args.serport)
 
-    # if a channel was explicitly specified, don't hop
+    if args.binary and not hw.enable_binary_framing():
+        print("Firmware doesn't support binary framing, using base64", file=sys.stderr)
+
+    # full resolution timestamps that don't wrap, when the firmware has them
+    ext_ts = hw.enable_ext_timestamps()
+
+    # a MAC list or several IRKs may match many advertisers, so don't hop for them
     hop3 = True if targ_specs else False
+    if args.maclist or (args.irk and ',' in args.irk):
+        hop3 = False
+
+    # if a channel was explicitly specified, don't hop
     if args.advchan == 40:
         args.advchan = 37
     else:
@@ -86,12 +128,25 @@ def main():
     mac = None
     irk = None
     if args.irk:
-        irk = unhexlify(args.irk)
+        irk = [unhexlify(k) for k in args.irk.split(',')]
+        if len(irk) == 1:
+            irk = irk[0]
     elif args.mac:
         try:
             mac = [int(h, 16) for h in reversed(args.mac.split(":"))]
         except:
             raise UsageError("MAC must be 6 colon-separated hex bytes")
+    elif args.maclist:
+        mac_list = []
+        with open(args.maclist, 'r') as f:
+            for line in f:
+                line = line.strip()
+                if not line or line.startswith('#'):
+                    continue
+                try:
+                    mac_list.append(bytes(int(h, 16) for h in reversed(line.split(":"))))
+                except:
+                    raise UsageError("MAC must be 6 colon-separated hex bytes")
     elif args.string:
         search_str = args.string.encode('latin-1').decode('unicode_escape').encode('latin-1')
         print("Waiting for advertisement containing specified string...")
@@ -126,28 +181,72 @@ def main():
             phy_preload=None if args.nophychange else PhyMode.PHY_2M,
             pause_done=args.pause,
             validate_crc=not args.crcerr)
+    if args.maclist:
+        hw.cmd_mac_list(mac_list, args.denylist)
+    hw.cmd_snaplen(args.snaplen)
+    hw.cmd_dedup(args.dedup)
+    hw.cmd_multi_conn(args.multiconn)
 
     # zero timestamps and flush old packets
     hw.mark_and_flush()
 
+    if args.stats:
+        Thread(target=poll_counters, daemon=True).start()
+
     global pcwriter
     if not (args.output is None):
-        pcwriter = PcapBleWriter(args.output)
+        pcwriter = PcapBleWriter(args.output, nanosecond=ext_ts)
 
-    while True:
-        try:
-            msg = hw.recv_and_decode()
+    # printing and pcap writing happen here, while pipeline threads keep reading
+    global pipeline
+    pipeline = CapturePipeline(hw)
+    pipeline.start()
+    try:
+        for msg in pipeline:
             print_message(msg, args.quiet, args.decode)
-        except SourceDone:
-            break
-        except KeyboardInterrupt:
-            hw.cancel_recv()
-            sys.stderr.write("\r")
-            break
+    except KeyboardInterrupt:
+        pipeline.stop()
+        sys.stderr.write("\r")
+
+    if pipeline.dropped or args.stats:
+        print(pipeline, file=sys.stderr)
+
+def poll_counters(interval=1.0):
+    while True:
+        sleep(interval)
+        hw.cmd_counters()
+
+def print_counters(counters):
+    global last_counters, last_rx_stats
+    prev = last_counters
+    last_counters = counters
+    prev_rx = last_rx_stats
+    last_rx_stats = hw.rx_stats()
+    if prev is None:
+        return
+    r = counters.rates(prev)
+    if r is None:
+        return
+    reads = last_rx_stats[0] - prev_rx[0]
+    msgs = last_rx_stats[2] - prev_rx[2]
+    print(("Stats: RX %.1f/s (CRC errors %.1f/s), RX overflows %.1f/s, drops %.1f/s, "
+           "UART %.0f B/s, commands %.1f/s, hops %.1f/s, missed anchors %.1f/s, "
+           "RPA lookups %.1f/s (cache hit rate %s), aux scheduler misses %.1f/s, "
+           "RX buffer full %.1f/s (max backlog %d), host serial reads per message %s, "
+           "host drops %d (max queue depth %d)") % (
+           r['rx_frames'], r['crc_errors'], r['rx_overflows'], r['pkt_drops'],
+           r['uart_bytes'], r['commands'], r['hops'], r['missed_anchors'],
+           r['rpa_lookups'], "%.0f%%" % (100 * r['rpa_cache_hits'] / r['rpa_lookups'])
+           if r['rpa_lookups'] else "n/a", r['aux_sched_misses'],
+           r['rx_buf_full'], counters.rx_backlog_max,
+           "%.2f" % (reads / msgs) if msgs else "n/a",
+           pipeline.dropped, pipeline.raw_max), end='\n\n')
 
 def print_message(msg, quiet, decode_ad):
     if isinstance(msg, PacketMessage):
         print_packet(msg, quiet, decode_ad)
+    elif isinstance(msg, CountersMeasurement):
+        print_counters(msg)
     elif isinstance(msg, DebugMessage) or isinstance(msg, StateMessage) or \
             isinstance(msg, MeasurementMessage):
         print(msg, end='\n\n')
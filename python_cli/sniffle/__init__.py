@@ -1,4 +1,5 @@
 __all__ = [
+    "cobs",
     "constants",
     "crc_ble",
     "decoder_state",
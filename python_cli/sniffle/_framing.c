@@ -0,0 +1,346 @@
+/*
+ * Written by Sultan Qasim Khan
+ * Copyright (c) 2024, NCC Group plc
+ * Released as open source under GPLv3
+ */
+
+// Native implementation of framing.parse_messages, see framing.py for the API,
+// and of the crc_ble.py CRC functions.
+// Build with: python3 setup.py build_ext --inplace
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <stdint.h>
+#include <string.h>
+
+#define MESSAGE_BLEFRAME        0x10
+#define MESSAGE_BLEFRAME_EXT    0x15
+#define FRAME_HDR_VERSION       1
+
+// Largest message firmware can send: length byte counts 3 byte words
+#define MSG_MAX (255 * 3)
+
+static int8_t b64_table[256];
+static uint16_t crc_table[256];
+static uint32_t crc24_table[256];
+
+static void init_tables(void)
+{
+    static const char alphabet[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    int i, j;
+
+    memset(b64_table, -1, sizeof(b64_table));
+    for (i = 0; i < 64; i++)
+        b64_table[(uint8_t)alphabet[i]] = i;
+
+    // CRC-16/CCITT-FALSE, as binascii.crc_hqx
+    for (i = 0; i < 256; i++)
+    {
+        uint16_t crc = i << 8;
+        for (j = 0; j < 8; j++)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        crc_table[i] = crc;
+    }
+
+    // BLE CRC-24 with bit reversed state, matching ble_crc_lut in crc_ble.py
+    for (i = 0; i < 256; i++)
+    {
+        uint32_t crc = i;
+        for (j = 0; j < 8; j++)
+            crc = (crc & 1) ? (crc >> 1) ^ 0xDA6000 : crc >> 1;
+        crc24_table[i] = crc;
+    }
+}
+
+static uint16_t crc16(const uint8_t *data, Py_ssize_t len)
+{
+    uint16_t crc = 0xFFFF;
+    Py_ssize_t i;
+
+    for (i = 0; i < len; i++)
+        crc = (crc << 8) ^ crc_table[((crc >> 8) ^ data[i]) & 0xFF];
+    return crc;
+}
+
+// returns decoded length, or -1 if malformed
+static Py_ssize_t b64_decode(const uint8_t *in, Py_ssize_t len, uint8_t *out)
+{
+    Py_ssize_t i, n = 0;
+
+    if (len & 3)
+        return -1;
+
+    for (i = 0; i < len; i += 4)
+    {
+        int a = b64_table[in[i]];
+        int b = b64_table[in[i + 1]];
+        int c = b64_table[in[i + 2]];
+        int d = b64_table[in[i + 3]];
+
+        if (a < 0 || b < 0)
+            return -1;
+        out[n++] = (a << 2) | (b >> 4);
+
+        // padding is only allowed in the final word
+        if (in[i + 2] == '=' && in[i + 3] == '=' && i + 4 == len)
+            break;
+        if (c < 0)
+            return -1;
+        out[n++] = (b << 4) | (c >> 2);
+
+        if (in[i + 3] == '=' && i + 4 == len)
+            break;
+        if (d < 0)
+            return -1;
+        out[n++] = (c << 6) | d;
+    }
+
+    return n;
+}
+
+// decodes COBS(message || CRC16), returns message length or -1 if malformed
+static Py_ssize_t frame_decode(const uint8_t *in, Py_ssize_t len, uint8_t *out)
+{
+    Py_ssize_t i = 0, n = 0;
+
+    while (i < len)
+    {
+        uint8_t code = in[i];
+        if (code == 0 || i + code > len)
+            return -1;
+        memcpy(out + n, in + i + 1, code - 1);
+        n += code - 1;
+        i += code;
+        if (code != 0xFF && i < len)
+            out[n++] = 0;
+    }
+
+    if (n < 3)
+        return -1;
+    if (crc16(out, n - 2) != (out[n - 2] | (out[n - 1] << 8)))
+        return -1;
+
+    return n - 2;
+}
+
+static int append_msg(PyObject *msgs, const uint8_t *data, Py_ssize_t len)
+{
+    uint8_t mtype = data[1];
+    const uint8_t *body = data + 2;
+    Py_ssize_t blen = len - 2;
+    PyObject *msg;
+    int ret;
+
+    if (mtype == MESSAGE_BLEFRAME && blen >= 10)
+    {
+        uint32_t ts;
+        uint16_t l, event;
+        memcpy(&ts, body, 4);
+        memcpy(&l, body + 4, 2);
+        memcpy(&event, body + 6, 2);
+        msg = Py_BuildValue("(ikiiiiy#)", mtype, (unsigned long)ts, l, event,
+                (int)(int8_t)body[8], body[9], body + 10, blen - 10);
+    } else if (mtype == MESSAGE_BLEFRAME_EXT && blen >= 15 &&
+            body[0] == FRAME_HDR_VERSION) {
+        uint64_t ts;
+        uint16_t l, event;
+        memcpy(&ts, body + 1, 8);
+        memcpy(&l, body + 9, 2);
+        memcpy(&event, body + 11, 2);
+        msg = Py_BuildValue("(iKiiiiy#)", mtype, (unsigned long long)ts, l, event,
+                (int)(int8_t)body[13], body[14], body + 15, blen - 15);
+    } else {
+        msg = Py_BuildValue("(iOiiiiy#)", mtype, Py_None, 0, 0, 0, 0, body, blen);
+    }
+
+    if (!msg)
+        return -1;
+    ret = PyList_Append(msgs, msg);
+    Py_DECREF(msg);
+    return ret;
+}
+
+static PyObject *parse_messages(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {"buf", "binary", "start", "end", NULL};
+    Py_buffer view;
+    int binary = 0;
+    const uint8_t *buf;
+    Py_ssize_t len, pos = 0, end_pos = -1, errors = 0;
+    uint8_t scratch[MSG_MAX + 4];
+    PyObject *msgs;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "y*|pnn", kwlist, &view, &binary,
+                &pos, &end_pos))
+        return NULL;
+    buf = view.buf;
+    len = view.len;
+    if (end_pos >= 0 && end_pos < len)
+        len = end_pos;
+    if (pos < 0)
+        pos = 0;
+    if (pos > len)
+        pos = len;
+
+    msgs = PyList_New(0);
+    if (!msgs)
+    {
+        PyBuffer_Release(&view);
+        return NULL;
+    }
+
+    for (;;)
+    {
+        const uint8_t *frame = buf + pos;
+        const uint8_t *end;
+        Py_ssize_t flen, dlen;
+
+        if (binary)
+        {
+            end = memchr(frame, 0, len - pos);
+            if (!end)
+                break;
+            flen = end - frame;
+            pos += flen + 1;
+        } else {
+            // find CRLF
+            end = frame;
+            for (;;)
+            {
+                end = memchr(end, '\r', buf + len - end);
+                if (!end || end + 1 >= buf + len || end[1] == '\n')
+                    break;
+                end++;
+            }
+            if (!end || end + 1 >= buf + len)
+                break;
+            flen = end - frame;
+            pos += flen + 2;
+        }
+
+        // empty frame from repeated delimiters
+        if (flen == 0)
+            continue;
+
+        if (binary)
+        {
+            // decoded frame is shorter than encoded, and carries a CRC
+            if (flen > MSG_MAX + 3)
+                dlen = -1;
+            else
+                dlen = frame_decode(frame, flen, scratch);
+        } else {
+            if (flen > MSG_MAX / 3 * 4)
+                dlen = -1;
+            else
+                dlen = b64_decode(frame, flen, scratch);
+            // first byte is the message length in base64 words
+            if (dlen > 0 && scratch[0] * 4 != flen)
+                dlen = -1;
+        }
+
+        if (dlen < 0)
+        {
+            errors++;
+            continue;
+        }
+        if (dlen < 2)
+            continue;
+
+        if (append_msg(msgs, scratch, dlen) < 0)
+        {
+            Py_DECREF(msgs);
+            PyBuffer_Release(&view);
+            return NULL;
+        }
+    }
+
+    PyBuffer_Release(&view);
+    return Py_BuildValue("(Nnn)", msgs, pos, errors);
+}
+
+static uint32_t crc24_rev(uint32_t state, const uint8_t *data, Py_ssize_t len)
+{
+    Py_ssize_t i;
+
+    state &= 0xFFFFFF;
+    for (i = 0; i < len; i++)
+        state = (state >> 8) ^ crc24_table[(state ^ data[i]) & 0xFF];
+    return state;
+}
+
+static PyObject *crc_ble_reverse(PyObject *self, PyObject *args)
+{
+    unsigned long init;
+    Py_buffer view;
+    uint32_t crc;
+
+    if (!PyArg_ParseTuple(args, "ky*", &init, &view))
+        return NULL;
+    crc = crc24_rev(init, view.buf, view.len);
+    PyBuffer_Release(&view);
+    return PyLong_FromUnsignedLong(crc);
+}
+
+static PyObject *crc_ble_reverse_batch(PyObject *self, PyObject *args)
+{
+    unsigned long init;
+    PyObject *bodies, *seq, *crcs;
+    Py_ssize_t i, n;
+
+    if (!PyArg_ParseTuple(args, "kO", &init, &bodies))
+        return NULL;
+    seq = PySequence_Fast(bodies, "bodies must be a sequence");
+    if (!seq)
+        return NULL;
+    n = PySequence_Fast_GET_SIZE(seq);
+    crcs = PyList_New(n);
+    if (!crcs)
+    {
+        Py_DECREF(seq);
+        return NULL;
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        Py_buffer view;
+        PyObject *crc;
+
+        if (PyObject_GetBuffer(PySequence_Fast_GET_ITEM(seq, i), &view, PyBUF_SIMPLE) < 0)
+            goto fail;
+        crc = PyLong_FromUnsignedLong(crc24_rev(init, view.buf, view.len));
+        PyBuffer_Release(&view);
+        if (!crc)
+            goto fail;
+        PyList_SET_ITEM(crcs, i, crc);
+    }
+
+    Py_DECREF(seq);
+    return crcs;
+
+fail:
+    Py_DECREF(seq);
+    Py_DECREF(crcs);
+    return NULL;
+}
+
+static PyMethodDef framing_methods[] = {
+    {"parse_messages", (PyCFunction)(void (*)(void))parse_messages,
+        METH_VARARGS | METH_KEYWORDS, "Parse complete messages from a UART buffer"},
+    {"crc_ble_reverse", crc_ble_reverse, METH_VARARGS,
+        "BLE CRC-24 of data, with bit reversed initial value and result"},
+    {"crc_ble_reverse_batch", crc_ble_reverse_batch, METH_VARARGS,
+        "crc_ble_reverse of each of a sequence of bodies"},
+    {NULL, NULL, 0, NULL}
+};
+
+static struct PyModuleDef framing_module = {
+    PyModuleDef_HEAD_INIT, "_framing", NULL, -1, framing_methods
+};
+
+PyMODINIT_FUNC PyInit__framing(void)
+{
+    init_tables();
+    return PyModule_Create(&framing_module);
+}
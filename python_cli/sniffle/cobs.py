@@ -0,0 +1,53 @@
+# Written by Sultan Qasim Khan
+# Copyright (c) 2024, NCC Group plc
+# Released as open source under GPLv3
+
+# Consistent Overhead Byte Stuffing, used for binary framing of the UART link.
+# Frames on the wire are COBS(message || CRC16) followed by a zero delimiter.
+
+from binascii import crc_hqx
+from struct import pack, unpack
+
+def cobs_encode(data) -> bytes:
+    out = bytearray()
+    for block in bytes(data).split(b'\x00'):
+        while len(block) >= 254:
+            out.append(0xFF)
+            out += block[:254]
+            block = block[254:]
+        out.append(len(block) + 1)
+        out += block
+    return bytes(out)
+
+def cobs_decode(data) -> bytes:
+    out = bytearray()
+    i = 0
+    n = len(data)
+    while i < n:
+        code = data[i]
+        if code == 0 or i + code > n:
+            raise ValueError("Malformed COBS data")
+        out += data[i + 1:i + code]
+        i += code
+        if code != 0xFF and i < n:
+            out.append(0)
+    if 0 in data:
+        raise ValueError("Unexpected zero in COBS data")
+    return bytes(out)
+
+# CRC-16/CCITT-FALSE, matching crc16_ccitt in the firmware
+def crc16(data) -> int:
+    return crc_hqx(data, 0xFFFF)
+
+def frame_encode(msg) -> bytes:
+    return cobs_encode(bytes(msg) + pack('<H', crc16(msg))) + b'\x00'
+
+# Takes a frame without its trailing delimiter, returns the message
+def frame_decode(frame) -> bytes:
+    data = cobs_decode(frame)
+    if len(data) < 3:
+        raise ValueError("Frame too short")
+    crc, = unpack('<H', data[-2:])
+    if crc != crc16(data[:-2]):
+        raise ValueError("Frame CRC mismatch")
+    return data[:-2]
@@ -38,19 +38,31 @@ ble_crc_lut = [
 
 # Bit reverse because BLE CRC goes over the air MSB first, but the received data is
 # interpreted LSB first because everything else is LSB first
-# This is a simple but terribly inefficient implementation
+_rbit8 = bytes(int(f'{i:08b}'[::-1], 2) for i in range(256))
+
 def rbit24(c):
-    return int(f'{c:024b}'[::-1], 2)
+    return (_rbit8[c & 0xFF] << 16) | (_rbit8[(c >> 8) & 0xFF] << 8) | _rbit8[(c >> 16) & 0xFF]
 
 # Based on https://gist.github.com/dominicgs/5524947
 # Described in https://greatscottgadgets.com/2013/05-07-speeding-up-crc-calculations-for-bluetooth-low-energy/
-def crc_ble_reverse(crc_init_reverse: int, data: bytes):
+# Slicing by 4 or 8 bytes doesn't help here, CPython spends its time per table
+# lookup rather than waiting on the state dependency between bytes.
+def _crc_ble_reverse_py(crc_init_reverse: int, data: bytes, lut=ble_crc_lut):
     state = crc_init_reverse & 0xFFFFFF
     for b in data:
-        key = b ^ (state & 0xFF)
-        state = (state >> 8) ^ ble_crc_lut[key]
+        state = (state >> 8) ^ lut[b ^ (state & 0xFF)]
     return state
 
+def _crc_ble_reverse_batch_py(crc_init_reverse: int, bodies):
+    return [_crc_ble_reverse_py(crc_init_reverse, b) for b in bodies]
+
+# Native versions are used when the _framing module has been built
+try:
+    from ._framing import crc_ble_reverse, crc_ble_reverse_batch
+except ImportError:
+    crc_ble_reverse = _crc_ble_reverse_py
+    crc_ble_reverse_batch = _crc_ble_reverse_batch_py
+
 def crc_ble(crc_init: int, data: bytes):
     crc_init_reverse = rbit24(crc_init)
     return rbit24(crc_ble_reverse(crc_init_reverse, data))
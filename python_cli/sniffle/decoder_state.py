@@ -2,6 +2,7 @@
 # Copyright (c) 2024, NCC Group plc
 # Released as open source under GPLv3
 
+from time import time_ns
 from .constants import BLE_ADV_AA, BLE_ADV_CRCI
 from .crc_ble import rbit24
 from .sniffer_state import SnifferState
@@ -14,6 +15,10 @@ class SniffleDecoderState:
         self.ts_wraps = 0
         self.last_ts = -1
 
+        # extended timestamp (64 bit radio ticks) tracking, no wraps to guess
+        self.zero_ticks = None
+        self.first_epoch_ns = 0
+
         # access address tracking
         self.cur_aa = 0 if is_data else BLE_ADV_AA
         self.crc_init_rev = rbit24(BLE_ADV_CRCI)
@@ -32,6 +37,19 @@ class SniffleDecoderState:
         # state tracking
         self.last_state = SnifferState.STATIC
 
+        # connection index -> (access address, reversed CRC init) for
+        # connections followed alongside the main one
+        self.secondary_conns = {}
+
+        # set on entering DATA state, when the next packet should be the
+        # CONNECT_IND that caused it rather than one heard between events
+        self.conn_ind_expected = False
+
+    # radio ticks (0.25 us) at which relative time is zero
+    def set_zero_ticks(self, ticks):
+        self.zero_ticks = ticks
+        self.first_epoch_ns = time_ns()
+
     def reset_adv(self):
         self.cur_aa = BLE_ADV_AA
         self.crc_init_rev = rbit24(BLE_ADV_CRCI)
@@ -0,0 +1,154 @@
+# Written by Sultan Qasim Khan
+# Copyright (c) 2024, NCC Group plc
+# Released as open source under GPLv3
+
+# Batch parsing of messages received from the sniffer UART.
+#
+# parse_messages(buf, binary=False, start=0, end=-1) scans buf[start:end] for
+# complete messages, either base64 lines terminated by CRLF or COBS frames
+# terminated by a zero byte, and returns (msgs, consumed, errors):
+#   msgs: list of (mtype, ts, len_dir, event, rssi, chan_phy, body) tuples.
+#       For BLE frame messages (0x10, or 0x15 with the expected header version),
+#       the frame header fields are unpacked and body is the PDU. ts is in
+#       microseconds for 0x10, or 0.25 us radio ticks for 0x15. For any other
+#       message, ts is None, the other header fields are 0, and body is the
+#       whole message body.
+#   consumed: index in buf just past the last complete message
+#   errors: number of malformed messages skipped
+#
+# The C implementation in _framing.c is used when it has been built
+# (python3 setup.py build_ext --inplace), otherwise the pure Python one.
+
+import re
+from binascii import a2b_base64, Error as BAError
+from struct import unpack_from
+from .cobs import frame_decode
+from .packet_decoder import FRAME_HDR_VERSION
+
+MESSAGE_BLEFRAME = 0x10
+MESSAGE_BLEFRAME_EXT = 0x15
+
+def _split(mtype, body):
+    if mtype == MESSAGE_BLEFRAME and len(body) >= 10:
+        ts, l, event, rssi, chan = unpack_from("<LHHbB", body, 0)
+        return mtype, ts, l, event, rssi, chan, body[10:]
+    elif mtype == MESSAGE_BLEFRAME_EXT and len(body) >= 15 and body[0] == FRAME_HDR_VERSION:
+        ts, l, event, rssi, chan = unpack_from("<QHHbB", body, 1)
+        return mtype, ts, l, event, rssi, chan, body[15:]
+    return mtype, None, 0, 0, 0, 0, body
+
+# Base64 must be validated to reject the same corrupted lines as the C parser:
+# whole words only, no characters outside the alphabet, padding only at the end.
+# a2b_base64 skips invalid characters, and even with strict_mode (Python 3.11+)
+# accepts extra padding after a complete word.
+_B64_RE = re.compile(rb'(?:[A-Za-z0-9+/]{4})*(?:[A-Za-z0-9+/]{2}==|[A-Za-z0-9+/]{3}=)?')
+
+def _b64_decode(frame):
+    if not _B64_RE.fullmatch(frame):
+        raise ValueError("Invalid base64")
+    return a2b_base64(frame)
+
+def parse_messages_py(buf, binary=False, start=0, end=-1):
+    msgs = []
+    errors = 0
+    pos = start
+    delim = b'\x00' if binary else b'\r\n'
+    if end < 0:
+        end = len(buf)
+
+    while True:
+        mend = buf.find(delim, pos, end)
+        if mend < 0:
+            break
+        frame = bytes(buf[pos:mend])
+        pos = mend + len(delim)
+
+        # empty frame from repeated delimiters
+        if len(frame) == 0:
+            continue
+
+        try:
+            if binary:
+                data = frame_decode(frame)
+            else:
+                data = _b64_decode(frame)
+                # first byte is the message length in base64 words
+                if len(data) and data[0] * 4 != len(frame):
+                    raise ValueError("Length mismatch")
+        except (ValueError, BAError):
+            errors += 1
+            continue
+
+        if len(data) < 2:
+            continue
+
+        msgs.append(_split(data[1], data[2:]))
+
+    return msgs, pos, errors
+
+try:
+    from ._framing import parse_messages
+    native = True
+except ImportError:
+    parse_messages = parse_messages_py
+    native = False
+
+# Buffer size should comfortably exceed what the OS buffers between reads
+RX_BUF_SIZE = 0x10000
+
+# Move unparsed data back to the start of the buffer when less room than this remains
+RX_READ_MIN = 0x1000
+
+# Unparsed data limit when no message delimiter is found, several max size messages
+RX_UNPARSED_MAX = 0x1000
+
+# Reusable receive buffer, filled with whatever the serial port has available
+# and parsed in place. Only the partial message at the end, if any, is ever
+# moved, and only when it gets near the end of the buffer.
+class RxBuffer:
+    def __init__(self, size=RX_BUF_SIZE):
+        self.buf = bytearray(size)
+        self.view = memoryview(self.buf)
+        self.start = 0
+        self.end = 0
+
+        # statistics
+        self.reads = 0
+        self.bytes = 0
+        self.msgs = 0
+
+    def __len__(self):
+        return self.end - self.start
+
+    def clear(self):
+        self.start = self.end = 0
+
+    # Read everything available, blocking (up to the port timeout) for at least one byte.
+    # Returns the number of bytes read.
+    def fill(self, ser):
+        if self.start == self.end:
+            self.start = self.end = 0
+        elif len(self.buf) - self.end < RX_READ_MIN:
+            n = self.end - self.start
+            self.buf[:n] = self.view[self.start:self.end]
+            self.start, self.end = 0, n
+
+        want = min(max(1, ser.in_waiting), len(self.buf) - self.end)
+        n = ser.readinto(self.view[self.end:self.end + want])
+        self.end += n
+        self.reads += 1
+        self.bytes += n
+        return n
+
+    # Returns (msgs, errors, discarded) with msgs and errors as from parse_messages,
+    # and discarded the number of bytes dropped for lack of a message delimiter.
+    def parse(self, binary=False):
+        msgs, self.start, errors = parse_messages(self.buf, binary, self.start, self.end)
+        self.msgs += len(msgs)
+
+        discarded = 0
+        if len(self) > RX_UNPARSED_MAX:
+            discarded = len(self)
+            self.clear()
+
+        return msgs, errors, discarded
@@ -13,6 +13,16 @@ class MeasurementType(IntEnum):
     WINOFFSET = 3
     DELTAINSTANT = 4
     VERSION = 5
+    TXBATCH = 6
+    DROPS = 7
+    COUNTERS = 8
+    DEDUP = 9
+    AESBENCH = 10
+    HOPLAT = 11
+    DRIFT = 12
+    CONN = 13
+    TRIGJITTER = 14
+    MACLIST = 15
 
 class MeasurementMessage:
     def __init__(self, raw_msg):
@@ -23,7 +33,7 @@ class MeasurementMessage:
 
     @staticmethod
     def from_raw(raw_msg):
-        if len(raw_msg) < 2 or raw_msg[1] > MeasurementType.VERSION:
+        if len(raw_msg) < 2 or raw_msg[1] > max(MeasurementType):
             return MeasurementMessage(raw_msg)
 
         if len(raw_msg) - 1 != raw_msg[0]:
@@ -35,7 +45,17 @@ class MeasurementMessage:
             MeasurementType.ADVHOP:         AdvHopMeasurement,
             MeasurementType.WINOFFSET:      WinOffsetMeasurement,
             MeasurementType.DELTAINSTANT:   DeltaInstantMeasurement,
-            MeasurementType.VERSION:        VersionMeasurement
+            MeasurementType.VERSION:        VersionMeasurement,
+            MeasurementType.TXBATCH:        TxBatchMeasurement,
+            MeasurementType.DROPS:          DropsMeasurement,
+            MeasurementType.COUNTERS:       CountersMeasurement,
+            MeasurementType.DEDUP:          DedupMeasurement,
+            MeasurementType.AESBENCH:       AesBenchMeasurement,
+            MeasurementType.HOPLAT:         HopLatencyMeasurement,
+            MeasurementType.DRIFT:          DriftMeasurement,
+            MeasurementType.CONN:           ConnMeasurement,
+            MeasurementType.TRIGJITTER:     TrigJitterMeasurement,
+            MeasurementType.MACLIST:        MacListMeasurement
             }
 
         mtype = MeasurementType(raw_msg[1])
@@ -90,3 +110,198 @@ class VersionMeasurement(MeasurementMessage):
     def __str__(self):
         return "Sniffle Firmware %d.%d.%d, API Level %d" % (
                 self.major, self.minor, self.revision, self.api_level)
+
+class TxBatchMeasurement(MeasurementMessage):
+    def __init__(self, raw_val):
+        self.batches, self.frames, self.max_batch = unpack("<LLH", raw_val)
+
+    def frames_per_batch(self):
+        return self.frames / self.batches if self.batches else 0.
+
+    def __str__(self):
+        return "UART Batches: %d, Frames: %d (%.2f per batch), Largest Batch: %d" % (
+                self.batches, self.frames, self.frames_per_batch(), self.max_batch)
+
+class DropsMeasurement(MeasurementMessage):
+    def __init__(self, raw_val):
+        self.queued, self.queue_full, self.oversize, self.filtered = unpack("<LLLL", raw_val)
+
+    def lost(self):
+        return self.queue_full + self.oversize
+
+    def __str__(self):
+        return "Frames Queued: %d, Lost: %d (%d queue full, %d oversize), Filtered: %d" % (
+                self.queued, self.lost(), self.queue_full, self.oversize, self.filtered)
+
+class CountersMeasurement(MeasurementMessage):
+    # Scalar counters, in firmware order, following the per-channel RX counts
+    fields = ("crc_errors", "rx_overflows", "uart_bytes", "commands", "hops", "missed_anchors",
+              "rpa_lookups", "rpa_cache_hits", "aux_sched_misses", "rx_buf_full",
+              "rx_backlog_max")
+
+    def __init__(self, raw_val):
+        vals = unpack("<LL40L%dL" % len(CountersMeasurement.fields), raw_val)
+        self.radio_ticks = vals[0] # 4 MHz radio timer
+        self.pkt_drops = vals[1]
+        self.rx_frames = list(vals[2:42])
+        for name, v in zip(CountersMeasurement.fields, vals[42:]):
+            setattr(self, name, v)
+
+    def rx_total(self):
+        return sum(self.rx_frames)
+
+    # Compute per second rates for all counters since a previous measurement
+    def rates(self, prev):
+        dt = ((self.radio_ticks - prev.radio_ticks) & 0xFFFFFFFF) / 4e6
+        if dt <= 0:
+            return None
+        r = {'rx_frames': ((self.rx_total() - prev.rx_total()) & 0xFFFFFFFF) / dt,
+             'pkt_drops': ((self.pkt_drops - prev.pkt_drops) & 0xFFFFFFFF) / dt}
+        for name in CountersMeasurement.fields:
+            r[name] = ((getattr(self, name) - getattr(prev, name)) & 0xFFFFFFFF) / dt
+        return r
+
+    def __str__(self):
+        return ("Firmware Counters: RX %d, CRC Errors %d, RX Overflows %d, Packet Drops %d, "
+                "UART Bytes %d, Commands %d, Hops %d, Missed Anchors %d, "
+                "RPA Lookups %d (%d cached), Aux Scheduler Misses %d, "
+                "RX Buffer Full %d, Max RX Backlog %d") % (
+                self.rx_total(), self.crc_errors, self.rx_overflows, self.pkt_drops,
+                self.uart_bytes, self.commands, self.hops, self.missed_anchors,
+                self.rpa_lookups, self.rpa_cache_hits, self.aux_sched_misses,
+                self.rx_buf_full, self.rx_backlog_max)
+
+class DedupMeasurement(MeasurementMessage):
+    # Summary of an advertisement repeated within the firmware dedup window.
+    # Only the first copy was forwarded; count includes that first copy.
+    def __init__(self, raw_val):
+        self.hdr = raw_val[0]
+        self.adv_a = raw_val[1:7]
+        self.hash, self.count, self.rssi_min, self.rssi_max = unpack("<LHbb", raw_val[7:])
+
+    def __str__(self):
+        mac = ":".join(["%02X" % b for b in reversed(self.adv_a)])
+        rand = " (random)" if self.hdr & 0x40 else ""
+        return "Dedup: %s%s seen %d times, RSSI %d to %d" % (
+                mac, rand, self.count, self.rssi_min, self.rssi_max)
+
+class AesBenchMeasurement(MeasurementMessage):
+    # CPU clock is 12x the 4 MHz radio timer used for firmware timing
+    CYCLES_PER_TICK = 12
+
+    def __init__(self, raw_val):
+        self.blocks, self.fast_ticks, self.ref_ticks, self.mismatches = unpack("<HLLH", raw_val)
+
+    def cycles_per_block(self, ticks):
+        if self.blocks == 0:
+            return 0
+        return ticks * AesBenchMeasurement.CYCLES_PER_TICK / self.blocks
+
+    def __str__(self):
+        return ("AES Benchmark: %d blocks, fast %.0f cycles/block, reference %.0f cycles/block, "
+                "%d mismatches") % (self.blocks, self.cycles_per_block(self.fast_ticks),
+                self.cycles_per_block(self.ref_ticks), self.mismatches)
+
+class DriftMeasurement(MeasurementMessage):
+    # Central clock drift tracked while following a connection, and how early
+    # the firmware starts listening before each expected anchor point
+    def __init__(self, raw_val):
+        drift_ppb, lead_ticks, jitter_q4 = unpack("<lHH", raw_val)
+        self.drift_ppm = drift_ppb / 1000
+        self.window_us = lead_ticks / 4
+        self.jitter_us = jitter_q4 / 64 # 1/16 radio ticks
+
+    def __str__(self):
+        return "Clock Drift: %.2f ppm, Window %.1f us, Anchor Jitter %.2f us" % (
+                self.drift_ppm, self.window_us, self.jitter_us)
+
+class ConnMeasurement(MeasurementMessage):
+    # Secondary connection followed between events of the main one.
+    # Sent when it is added, periodically, and when it is lost.
+    # Connections that can't be followed for lack of a free slot are
+    # reported as rejected, with connection index 255.
+    ADDED = 0
+    STATS = 1
+    LOST = 2
+    REJECTED = 3
+
+    def __init__(self, raw_val):
+        (self.conn, self.reason, self.aa, self.crc_init, self.interval, self.events,
+         self.anchors, self.skipped, self.collisions) = unpack("<BBLLHLLLL", raw_val)
+
+    def __str__(self):
+        reasons = {self.ADDED: "Added", self.STATS: "Stats", self.LOST: "Lost",
+                   self.REJECTED: "Rejected"}
+        return ("Connection %d %s: AA 0x%08X, Interval %.2f ms, %d events, %d anchors, "
+                "%d skipped (%d collisions)") % (self.conn, reasons.get(self.reason, "?"),
+                self.aa, self.interval * 1.25, self.events, self.anchors, self.skipped,
+                self.collisions)
+
+class TrigJitterMeasurement(MeasurementMessage):
+    # Scheduled and actual radio time of a timed hop or stop trigger
+    HOP = 0
+    STOP = 1
+
+    def __init__(self, raw_val):
+        self.kind, self.scheduled, self.actual = unpack("<BLL", raw_val)
+
+    # microseconds the trigger acted after its scheduled time
+    @property
+    def late_us(self):
+        late = (self.actual - self.scheduled) & 0xFFFFFFFF
+        if late >= 0x80000000:
+            late -= 0x100000000
+        return late / 4
+
+    def __str__(self):
+        kind = "Hop" if self.kind == self.HOP else "Stop"
+        return "%s Trigger: scheduled %d, actual %d (%+.2f us)" % (
+                kind, self.scheduled, self.actual, self.late_us)
+
+class MacListMeasurement(MeasurementMessage):
+    # Sent when the MAC list is cleared, and when MACs are rejected because it is full
+    def __init__(self, raw_val):
+        self.count, self.capacity, self.rejected = unpack("<HHH", raw_val)
+
+    def __str__(self):
+        if self.rejected:
+            return "MAC List: full with %d MACs, %d rejected" % (self.count, self.rejected)
+        return "MAC List: %d of %d MACs" % (self.count, self.capacity)
+
+class HopLatencyMeasurement(MeasurementMessage):
+    # Histogram of delay from a receive ending at its scheduled time to the next
+    # receive command being issued. The last bucket also counts longer delays.
+    def __init__(self, raw_val):
+        self.bucket_us = unpack("<H", raw_val[:2])[0]
+        self.counts = list(unpack("<%dL" % ((len(raw_val) - 2) // 4), raw_val[2:]))
+
+    def total(self):
+        return sum(self.counts)
+
+    # Upper bound in microseconds of the bucket containing the given percentile
+    def percentile(self, pct):
+        target = self.total() * pct / 100
+        seen = 0
+        for i, c in enumerate(self.counts):
+            seen += c
+            if c and seen >= target:
+                return (i + 1) * self.bucket_us
+        return 0
+
+    def histogram(self):
+        lines = []
+        for i, c in enumerate(self.counts):
+            if not c:
+                continue
+            lo = i * self.bucket_us
+            if i == len(self.counts) - 1:
+                lines.append("%4d+ us: %d" % (lo, c))
+            else:
+                lines.append("%4d-%d us: %d" % (lo, lo + self.bucket_us, c))
+        return "\n".join(lines)
+
+    def __str__(self):
+        if not self.total():
+            return "Hop Latency: no hops recorded"
+        return "Hop Latency: %d hops, median <%d us, p99 <%d us" % (
+                self.total(), self.percentile(50), self.percentile(99))
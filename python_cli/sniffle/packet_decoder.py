@@ -4,11 +4,11 @@
 # Copyright (c) 2019-2024, NCC Group plc
 # Released as open source under GPLv3
 
-from struct import pack, unpack
+from struct import pack, unpack, unpack_from
 from traceback import print_exception
 from time import time
 from .crc_ble import rbit24
-from .constants import BLE_ADV_AA
+from .constants import BLE_ADV_AA, BLE_ADV_CRCI
 from .sniffer_state import SnifferState
 from .decoder_state import SniffleDecoderState
 from .crc_ble import crc_ble_reverse, rbit24
@@ -34,54 +34,111 @@ def str_mac2(mac, is_random):
 # radio time wraparound period in seconds
 TS_WRAP_PERIOD = 0x100000000 / 4E6
 
+# extended frame header version understood by this decoder
+FRAME_HDR_VERSION = 1
+
+# Packet classes use __slots__, and decoded classes parse most fields from the
+# body on access rather than up front, so capture-only use stays cheap.
 class PacketMessage:
-    def __init__(self, raw_msg, dstate: SniffleDecoderState, crc_rev=None):
-        ts, l, event, rssi, chan = unpack("<LHHbB", raw_msg[:10])
-        body = raw_msg[10:]
+    __slots__ = ('ts', 'ts_epoch', 'ts_epoch_ns', 'aa', 'rssi', 'chan', 'phy', 'body',
+                 'orig_len', 'data_dir', 'crc_err', 'event', 'conn', '_crc_rev', '_crc_init_rev')
+
+    def __init__(self, raw_msg, dstate: SniffleDecoderState, crc_rev=None, ext_ts=False):
+        if ext_ts:
+            # versioned header with 64 bit timestamp in 0.25 us radio ticks
+            if raw_msg[0] != FRAME_HDR_VERSION:
+                raise SniffleHWPacketError("Unsupported frame header version %d" % raw_msg[0])
+            ts, l, event, rssi, chan = unpack("<QHHbB", raw_msg[1:15])
+            body = raw_msg[15:]
+        else:
+            ts, l, event, rssi, chan = unpack("<LHHbB", raw_msg[:10])
+            body = raw_msg[10:]
+        self._init_fields(ts, l, event, rssi, chan, body, dstate, crc_rev, ext_ts)
 
+    # ts is in 0.25 us radio ticks if ext_ts, otherwise in microseconds
+    def _init_fields(self, ts, l, event, rssi, chan, body, dstate, crc_rev, ext_ts):
         # MSB of length is actually packet direction
+        # bits 11-13 are the connection index when following several connections
         pkt_dir = l >> 15
         crc_err = True if (l & 0x4000) else False
-        l &= 0x3FFF
+        conn = (l >> 11) & 0x7
+        l &= 0x7FF
 
-        if len(body) != l:
+        # body may be shorter than length if firmware truncated it (snaplen)
+        if len(body) > l:
             raise SniffleHWPacketError("Incorrect length field!")
 
         phy = chan >> 6
         chan &= 0x3F
 
-        if chan >= 37 and dstate.cur_aa != BLE_ADV_AA:
-            dstate.reset_adv()
-
-        if dstate.time_offset > 0:
-            dstate.first_epoch_time = time()
-            dstate.time_offset = ts / -1000000.
+        if conn:
+            # secondary connection, announced by the firmware before its first packet
+            aa, crc_init_rev = dstate.secondary_conns.get(conn, (0, None))
+        elif chan >= 37 and dstate.last_state == SnifferState.DATA:
+            # scanning for new connections between events of the one being followed
+            aa, crc_init_rev = BLE_ADV_AA, rbit24(BLE_ADV_CRCI)
+        else:
+            if chan >= 37 and dstate.cur_aa != BLE_ADV_AA:
+                dstate.reset_adv()
+            aa, crc_init_rev = dstate.cur_aa, dstate.crc_init_rev
+
+        if ext_ts:
+            if dstate.zero_ticks is None:
+                dstate.set_zero_ticks(ts)
+            real_ts_ns = (ts - dstate.zero_ticks) * 250
+            ts_epoch_ns = dstate.first_epoch_ns + real_ts_ns
+            real_ts = real_ts_ns / 1E9
+            real_ts_epoch = ts_epoch_ns / 1E9
+        else:
+            if dstate.time_offset > 0:
+                dstate.first_epoch_time = time()
+                dstate.time_offset = ts / -1000000.
 
-        if ts < dstate.last_ts:
-            dstate.ts_wraps += 1
-        dstate.last_ts = ts
+            if ts < dstate.last_ts:
+                dstate.ts_wraps += 1
+            dstate.last_ts = ts
 
-        real_ts = dstate.time_offset + (ts / 1000000.) + (dstate.ts_wraps * TS_WRAP_PERIOD)
-        real_ts_epoch = dstate.first_epoch_time + real_ts
+            real_ts = dstate.time_offset + (ts / 1000000.) + (dstate.ts_wraps * TS_WRAP_PERIOD)
+            real_ts_epoch = dstate.first_epoch_time + real_ts
+            ts_epoch_ns = round(real_ts_epoch * 1E6) * 1000
 
         # Now actually set instance attributes
         self.ts = real_ts
         self.ts_epoch = real_ts_epoch
-        self.aa = dstate.cur_aa
+        self.ts_epoch_ns = ts_epoch_ns
+        self.aa = aa
         self.rssi = rssi
         self.chan = chan
         self.phy = phy
         self.body = body
+        self.orig_len = l
         self.data_dir = pkt_dir
         self.crc_err = crc_err
         self.event = event
+        self.conn = conn
 
+        # CRC is only computed if needed, see crc_rev
+        self._crc_init_rev = crc_init_rev
         if crc_rev:
-            self.crc_rev = crc_rev
-        elif crc_err:
-            self.crc_rev = -1
+            self._crc_rev = crc_rev
+        elif crc_err or len(body) < l or crc_init_rev is None:
+            self._crc_rev = -1
         else:
-            self.crc_rev = crc_ble_reverse(dstate.crc_init_rev, body)
+            self._crc_rev = None
+
+    # Bit reversed CRC of the body, or -1 if it can't be recomputed
+    @property
+    def crc_rev(self):
+        if self._crc_rev is None:
+            self._crc_rev = crc_ble_reverse(self._crc_init_rev, self.body)
+        return self._crc_rev
+
+    # Build from frame header fields already unpacked by framing.parse_messages
+    @staticmethod
+    def from_header(ts, l, event, rssi, chan, body, dstate, ext_ts=False):
+        pkt = PacketMessage.__new__(PacketMessage)
+        pkt._init_fields(ts, l, event, rssi, chan, body, dstate, None, ext_ts)
+        return pkt
 
     @staticmethod
     def from_body(body, is_data=False, peripheral_send=False, is_aux_adv=False):
@@ -105,17 +162,27 @@ class PacketMessage:
                 type(self).__name__, self.ts, self.aa, self.rssi, self.chan, self.phy,
                 self.event, repr(self.body))
 
+    @property
+    def truncated(self):
+        return len(self.body) < self.orig_len
+
     def str_header(self):
         phy_names = ["1M", "2M", "Coded (S=8)", "Coded (S=2)"]
-        if self.crc_err:
-            if self.crc_rev >= 0:
-                crc_str = "0x%06X (Invalid)" % rbit24(self.crc_rev)
-            else:
-                crc_str = "Invalid"
+        if self.crc_rev < 0:
+            # CRC can't be recomputed over a truncated body
+            crc_str = "Invalid" if self.crc_err else "Unknown"
+        elif self.crc_err:
+            crc_str = "0x%06X (Invalid)" % rbit24(self.crc_rev)
         else:
             crc_str = "0x%06X" % rbit24(self.crc_rev)
-        return "Timestamp: %8.6f  Length: %2i  RSSI: %3i  Channel: %2i  PHY: %s  CRC: %s" % (
-            self.ts, len(self.body), self.rssi, self.chan, phy_names[self.phy], crc_str)
+        len_str = "%2i" % self.orig_len
+        if self.truncated:
+            len_str += " (%i captured)" % len(self.body)
+        hdr = "Timestamp: %8.6f  Length: %s  RSSI: %3i  Channel: %2i  PHY: %s  CRC: %s" % (
+            self.ts, len_str, self.rssi, self.chan, phy_names[self.phy], crc_str)
+        if self.conn:
+            hdr += "  Conn: %i" % self.conn
+        return hdr
 
     def hexdump(self):
         return hexdump(self.body)
@@ -124,21 +191,44 @@ class PacketMessage:
         return "\n".join([self.str_header(), self.hexdump()])
 
 class DPacketMessage(PacketMessage):
+    __slots__ = ()
     pdutype = "RFU"
 
+    # shorter bodies fail to decode, unless truncated by snaplen
+    min_len = 0
+
     # copy constructor, deliberately no call to super()
     def __init__(self, pkt: PacketMessage):
         self.ts = pkt.ts
         self.ts_epoch = pkt.ts_epoch
+        self.ts_epoch_ns = pkt.ts_epoch_ns
         self.aa = pkt.aa
         self.rssi = pkt.rssi
         self.chan = pkt.chan
         self.phy = pkt.phy
         self.body = pkt.body
+        self.orig_len = pkt.orig_len
         self.data_dir = pkt.data_dir
         self.crc_err = pkt.crc_err
         self.event = pkt.event
-        self.crc_rev = pkt.crc_rev
+        self.conn = pkt.conn
+        self._crc_rev = pkt._crc_rev
+        self._crc_init_rev = pkt._crc_init_rev
+
+        if len(self.body) < self.min_len and not self.truncated:
+            raise ValueError("%s too short!" % self.pdutype)
+
+    # Body bytes [start:end], or None if a truncated body ends before them
+    def _bytes_at(self, start, end):
+        return self.body[start:end] if len(self.body) >= end else None
+
+    def _byte_at(self, i):
+        return self.body[i] if len(self.body) > i else None
+
+    def _unpack_at(self, fmt, pos, size):
+        if len(self.body) < pos + size:
+            return None
+        return unpack_from(fmt, self.body, pos)[0]
 
     def _str_decode(self):
         raise NotImplementedError("Use a derived class")
@@ -147,7 +237,7 @@ class DPacketMessage(PacketMessage):
         try:
             return self._str_decode()
         except:
-            return "Decode error"
+            return "Truncated, not decoded" if self.truncated else "Decode error"
 
     def __str__(self):
         return "\n".join([self.str_header(), self.str_decode(), self.hexdump()])
@@ -168,12 +258,24 @@ class DPacketMessage(PacketMessage):
         return dpkt
 
 class AdvertMessage(DPacketMessage):
-    def __init__(self, pkt: PacketMessage):
-        super().__init__(pkt)
-        self.ChSel = (self.body[0] >> 5) & 1
-        self.TxAdd = (self.body[0] >> 6) & 1
-        self.RxAdd = (self.body[0] >> 7) & 1
-        self.ad_length = self.body[1]
+    __slots__ = ()
+    min_len = 2
+
+    @property
+    def ChSel(self):
+        return (self.body[0] >> 5) & 1
+
+    @property
+    def TxAdd(self):
+        return (self.body[0] >> 6) & 1
+
+    @property
+    def RxAdd(self):
+        return (self.body[0] >> 7) & 1
+
+    @property
+    def ad_length(self):
+        return self.body[1]
 
     def str_adtype(self):
         atstr = "Ad Type: %s\n" % self.pdutype
@@ -229,12 +331,24 @@ class AdvertMessage(DPacketMessage):
         return tc(pkt)
 
 class DataMessage(DPacketMessage):
-    def __init__(self, pkt: PacketMessage):
-        super().__init__(pkt)
-        self.NESN = (self.body[0] >> 2) & 1
-        self.SN = (self.body[0] >> 3) & 1
-        self.MD = (self.body[0] >> 4) & 1
-        self.data_length = self.body[1]
+    __slots__ = ()
+    min_len = 2
+
+    @property
+    def NESN(self):
+        return (self.body[0] >> 2) & 1
+
+    @property
+    def SN(self):
+        return (self.body[0] >> 3) & 1
+
+    @property
+    def MD(self):
+        return (self.body[0] >> 4) & 1
+
+    @property
+    def data_length(self):
+        return self.body[1]
 
     def str_datatype(self):
         dtstr = "LLID: %s\n" % self.pdutype
@@ -262,17 +376,21 @@ class DataMessage(DPacketMessage):
         return type_classes[LLID](pkt)
 
 class LlDataMessage(DataMessage):
+    __slots__ = ()
     pdutype = "LL DATA"
 
 class LlDataContMessage(DataMessage):
+    __slots__ = ()
     pdutype = "LL DATA CONT"
 
 class LlControlMessage(DataMessage):
+    __slots__ = ()
     pdutype = "LL CONTROL"
+    min_len = 3
 
-    def __init__(self, pkt: PacketMessage):
-        super().__init__(pkt)
-        self.opcode = self.body[2]
+    @property
+    def opcode(self):
+        return self._byte_at(2)
 
     def str_opcode(self):
         control_opcodes = [
@@ -314,10 +432,15 @@ class LlControlMessage(DataMessage):
             self.str_opcode()])
 
 class AdvaMessage(AdvertMessage):
-    def __init__(self, pkt: PacketMessage):
-        super().__init__(pkt)
-        self.AdvA = self.body[2:8]
-        self.adv_data = self.body[8:]
+    __slots__ = ()
+
+    @property
+    def AdvA(self):
+        return self._bytes_at(2, 8)
+
+    @property
+    def adv_data(self):
+        return self.body[8:]
 
     def str_adva(self):
         return "AdvA: %s" % str_mac2(self.AdvA, self.TxAdd)
@@ -328,25 +451,36 @@ class AdvaMessage(AdvertMessage):
             self.str_adva()])
 
 class AdvIndMessage(AdvaMessage):
+    __slots__ = ()
     pdutype = "ADV_IND"
 
 class AdvNonconnIndMessage(AdvaMessage):
+    __slots__ = ()
     pdutype = "ADV_NONCONN_IND"
 
 class ScanRspMessage(AdvaMessage):
+    __slots__ = ()
     pdutype = "SCAN_RSP"
 
 class AdvScanIndMessage(AdvaMessage):
+    __slots__ = ()
     pdutype = "ADV_SCAN_IND"
 
 class AdvDirectIndMessage(AdvertMessage):
+    __slots__ = ()
     pdutype = "ADV_DIRECT_IND"
 
-    def __init__(self, pkt: PacketMessage):
-        super().__init__(pkt)
-        self.AdvA = self.body[2:8]
-        self.TargetA = self.body[8:14]
-        self.adv_data = self.body[14:]
+    @property
+    def AdvA(self):
+        return self._bytes_at(2, 8)
+
+    @property
+    def TargetA(self):
+        return self._bytes_at(8, 14)
+
+    @property
+    def adv_data(self):
+        return self.body[14:]
 
     def str_ata(self):
         return "AdvA: %s TargetA: %s" % (str_mac2(self.AdvA, self.TxAdd), str_mac2(self.TargetA, self.RxAdd))
@@ -357,12 +491,16 @@ class AdvDirectIndMessage(AdvertMessage):
             self.str_ata()])
 
 class ScanReqMessage(AdvertMessage):
+    __slots__ = ()
     pdutype = "SCAN_REQ"
 
-    def __init__(self, pkt: PacketMessage):
-        super().__init__(pkt)
-        self.ScanA = self.body[2:8]
-        self.AdvA = self.body[8:14]
+    @property
+    def ScanA(self):
+        return self._bytes_at(2, 8)
+
+    @property
+    def AdvA(self):
+        return self._bytes_at(8, 14)
 
     def str_asa(self):
         return "ScanA: %s AdvA: %s" % (str_mac2(self.ScanA, self.TxAdd), str_mac2(self.AdvA, self.RxAdd))
@@ -373,23 +511,64 @@ class ScanReqMessage(AdvertMessage):
             self.str_asa()])
 
 class AuxScanReqMessage(ScanReqMessage):
+    __slots__ = ()
     pdutype = "AUX_SCAN_REQ"
 
 class ConnectIndMessage(AdvertMessage):
+    __slots__ = ()
     pdutype = "CONNECT_IND"
+    min_len = 36
 
-    def __init__(self, pkt: PacketMessage):
-        super().__init__(pkt)
-        self.InitA = self.body[2:8]
-        self.AdvA = self.body[8:14]
-        self.aa_conn = unpack('<L', self.body[14:18])[0]
-        self.CRCInit = self.body[18] | (self.body[19] << 8) | (self.body[20] << 16)
-        self.WinSize = self.body[21]
-        self.WinOffset, self.Interval, self.Latency, self.Timeout = unpack(
-                "<HHHH", self.body[22:30])
-        self.ChM = self.body[30:35]
-        self.Hop = self.body[35] & 0x1F
-        self.SCA = self.body[35] >> 5
+    @property
+    def InitA(self):
+        return self._bytes_at(2, 8)
+
+    @property
+    def AdvA(self):
+        return self._bytes_at(8, 14)
+
+    @property
+    def aa_conn(self):
+        return self._unpack_at('<L', 14, 4)
+
+    @property
+    def CRCInit(self):
+        crci = self._bytes_at(18, 21)
+        return None if crci is None else crci[0] | (crci[1] << 8) | (crci[2] << 16)
+
+    @property
+    def WinSize(self):
+        return self._byte_at(21)
+
+    @property
+    def WinOffset(self):
+        return self._unpack_at('<H', 22, 2)
+
+    @property
+    def Interval(self):
+        return self._unpack_at('<H', 24, 2)
+
+    @property
+    def Latency(self):
+        return self._unpack_at('<H', 26, 2)
+
+    @property
+    def Timeout(self):
+        return self._unpack_at('<H', 28, 2)
+
+    @property
+    def ChM(self):
+        return self._bytes_at(30, 35)
+
+    @property
+    def Hop(self):
+        hs = self._byte_at(35)
+        return None if hs is None else hs & 0x1F
+
+    @property
+    def SCA(self):
+        hs = self._byte_at(35)
+        return None if hs is None else hs >> 5
 
     def str_aia(self):
         return "InitA: %s AdvA: %s AA: 0x%08X CRCInit: 0x%06X" % (
@@ -421,6 +600,7 @@ class ConnectIndMessage(AdvertMessage):
             self.str_chm()])
 
 class AuxConnectReqMessage(ConnectIndMessage):
+    __slots__ = ()
     pdutype = "AUX_CONNECT_REQ"
 
 class AuxPtr:
@@ -451,58 +631,99 @@ class AdvDataInfo:
         return False
 
 class AdvExtIndMessage(AdvertMessage):
+    __slots__ = ('_hdr',)
     pdutype = "ADV_EXT_IND"
+    min_len = 3
 
     def __init__(self, pkt: PacketMessage):
         super().__init__(pkt)
-        self.AdvA = None
-        self.TargetA = None
-        self.CTEInfo = None
-        self.AdvDataInfo = None
-        self.AuxPtr = None
-        self.SyncInfo = None
-        self.TxPower = None
-        self.ACAD = None
-
-        if len(self.body) < 3:
-            raise ValueError("Extended advertisement too short!")
-        self.AdvMode = self.body[2] >> 6 # Neither, Connectable, Scannable, or RFU
-        hdrBodyLen = self.body[2] & 0x3F
-
-        if len(self.body) < hdrBodyLen + 1:
+        self._hdr = None
+        if not self.truncated and len(self.body) < (self.body[2] & 0x3F) + 1:
             raise ValueError("Inconistent header length!")
 
-        hdrFlags = self.body[3]
-        hdrPos = 4
+    # Extended header fields are parsed together on first access. Fields that
+    # would run past the end of a malformed or truncated header are left as None.
+    def _parse_hdr(self):
+        body = self.body
+        hdrBodyLen = body[2] & 0x3F if len(body) > 2 else 0
+        hdrEnd = min(3 + hdrBodyLen, len(body))
+        AdvA = TargetA = CTEInfo = ADI = Ptr = SyncInfo = TxPower = ACAD = None
 
-        if hdrFlags & 0x01:
-            self.AdvA = self.body[hdrPos:hdrPos+6]
-            hdrPos += 6
-        if hdrFlags & 0x02:
-            self.TargetA = self.body[hdrPos:hdrPos+6]
-            hdrPos += 6
-        if hdrFlags & 0x04:
-            self.CTEInfo = self.body[hdrPos]
-            hdrPos += 1
-        if hdrFlags & 0x08:
-            self.AdvDataInfo = AdvDataInfo(self.body[hdrPos:hdrPos+2])
-            hdrPos += 2
-        if hdrFlags & 0x10:
-            self.AuxPtr = AuxPtr(self.body[hdrPos:hdrPos+3])
-            hdrPos += 3
-        if hdrFlags & 0x20:
-            # TODO decode this nicely
-            self.SyncInfo = self.body[hdrPos:hdrPos+18]
-            hdrPos += 18
-        if hdrFlags & 0x40:
-            self.TxPower = unpack("b", self.body[hdrPos:hdrPos+1])[0]
-            hdrPos += 1
-        if hdrPos - 3 < hdrBodyLen:
-            ACADLen = hdrBodyLen - (hdrPos - 3)
-            self.ACAD = self.body[hdrPos:hdrPos+ACADLen]
-            hdrPos += ACADLen
-
-        self.adv_data = self.body[hdrPos:]
+        hdrFlags = body[3] if hdrBodyLen else 0
+        hdrPos = 4
+        fields = []
+        for bit, size in ((0x01, 6), (0x02, 6), (0x04, 1), (0x08, 2),
+                          (0x10, 3), (0x20, 18), (0x40, 1)):
+            if not (hdrFlags & bit):
+                fields.append(None)
+            elif hdrPos + size > hdrEnd:
+                fields.append(None)
+                hdrPos = hdrEnd
+            else:
+                fields.append(body[hdrPos:hdrPos+size])
+                hdrPos += size
+        AdvA, TargetA, CTEInfo, ADI, Ptr, SyncInfo, TxPower = fields
+
+        if CTEInfo is not None:
+            CTEInfo = CTEInfo[0]
+        if ADI is not None:
+            ADI = AdvDataInfo(ADI)
+        if Ptr is not None:
+            Ptr = AuxPtr(Ptr)
+        if TxPower is not None:
+            TxPower = unpack("b", TxPower)[0]
+        if hdrPos < hdrEnd:
+            ACAD = body[hdrPos:hdrEnd]
+            hdrPos = hdrEnd
+
+        self._hdr = (AdvA, TargetA, CTEInfo, ADI, Ptr, SyncInfo, TxPower, ACAD, hdrPos)
+        return self._hdr
+
+    def _field(self, i):
+        hdr = self._hdr if self._hdr else self._parse_hdr()
+        return hdr[i]
+
+    @property
+    def AdvMode(self):
+        ehl = self._byte_at(2)
+        return None if ehl is None else ehl >> 6 # Neither, Connectable, Scannable, or RFU
+
+    @property
+    def AdvA(self):
+        return self._field(0)
+
+    @property
+    def TargetA(self):
+        return self._field(1)
+
+    @property
+    def CTEInfo(self):
+        return self._field(2)
+
+    @property
+    def AdvDataInfo(self):
+        return self._field(3)
+
+    @property
+    def AuxPtr(self):
+        return self._field(4)
+
+    # TODO decode this nicely
+    @property
+    def SyncInfo(self):
+        return self._field(5)
+
+    @property
+    def TxPower(self):
+        return self._field(6)
+
+    @property
+    def ACAD(self):
+        return self._field(7)
+
+    @property
+    def adv_data(self):
+        return self.body[self._field(8):]
 
     def str_aext(self):
         amodes = ["Non-connectable, non-scannable",
@@ -543,20 +764,33 @@ def get_adi(pkt: PacketMessage):
     return dpkt.AdvDataInfo
 
 class AuxAdvIndMessage(AdvExtIndMessage):
+    __slots__ = ()
     pdutype = "AUX_ADV_IND"
 
 class AuxScanRspMessage(AuxAdvIndMessage):
+    __slots__ = ()
     pdutype = "AUX_SCAN_RSP"
 
 class AuxChainIndMessage(AuxAdvIndMessage):
+    __slots__ = ()
     pdutype = "AUX_CHAIN_IND"
 
 class AuxConnectRspMessage(AdvExtIndMessage):
+    __slots__ = ()
     pdutype = "AUX_CONNECT_RSP"
 
 def update_state(pkt: DPacketMessage, dstate: SniffleDecoderState):
-    if isinstance(pkt, ConnectIndMessage):
-        if pkt.chan < 37 and dstate.last_state != SnifferState.ADVERTISING_EXT:
+    conn_ind_expected = dstate.conn_ind_expected
+    dstate.conn_ind_expected = False
+
+    if isinstance(pkt, ConnectIndMessage) and pkt.CRCInit is None:
+        pass # truncated before the connection parameters
+    elif isinstance(pkt, ConnectIndMessage):
+        if dstate.last_state == SnifferState.DATA and not conn_ind_expected:
+            # heard between events, firmware may or may not follow it alongside
+            # the current connection, and reports which with CONN measurements
+            pass
+        elif pkt.chan < 37 and dstate.last_state != SnifferState.ADVERTISING_EXT:
             dstate.aux_pending_aa = pkt.aa_conn
             dstate.aux_pending_crci = pkt.CRCInit
         else:
@@ -37,6 +37,9 @@ from .packet_decoder import (PacketMessage, DPacketMessage, DataMessage,
 from .constants import BLE_ADV_AA
 from .decoder_state import SniffleDecoderState
 
+PCAP_MAGIC_USEC = 0xa1b2c3d4
+PCAP_MAGIC_NSEC = 0xa1b23c4d
+
 def rf_to_ble_chan(chan):
     if chan == 0:
         return 37
@@ -67,7 +70,10 @@ class PcapBleWriter:
     """
     DLT = 256 # DLT_BLUETOOTH_LE_LL_WITH_PHDR
 
-    def __init__(self, output=None):
+    def __init__(self, output=None, nanosecond=False):
+        # nanosecond resolution pcap uses a different magic number
+        self.nanosecond = nanosecond
+
         # open stream
         if output is None:
             self.output = BytesIO()
@@ -87,7 +93,7 @@ class PcapBleWriter:
         """
         header = pack(
             '<IHHIIII',
-            0xa1b2c3d4,
+            PCAP_MAGIC_NSEC if self.nanosecond else PCAP_MAGIC_USEC,
             2,
             4,
             0,
@@ -97,27 +103,33 @@ class PcapBleWriter:
         )
         self.output.write(header)
 
-    def write_packet_header(self, ts_sec, ts_usec, packet_size):
+    def write_packet_header(self, ts_sec, ts_frac, packet_size, orig_size=None):
         """
         Write packet header
+        ts_frac is in nanoseconds for nanosecond resolution output, microseconds otherwise
         """
         pkt_header = pack(
             '<IIII',
             ts_sec,
-            ts_usec,
+            ts_frac,
             packet_size,
-            packet_size
+            orig_size if orig_size else packet_size
         )
         self.output.write(pkt_header)
 
-    def payload(self, aa, packet, chan, rssi, phy, pdu_type, aux_type, crc_rev, crc_err):
+    def payload(self, aa, packet, chan, rssi, phy, pdu_type, aux_type, crc_rev, crc_err,
+                truncated=False):
         """
         Generate payload with specific header.
+        Truncated packets have no CRC bytes, since the CRC is unknown.
         """
-        # 0x0413 means dewhitened, signal power valid, ref AA valid, CRC checked
-        flags = 0x0413
-        if not crc_err:
-            flags |= 0x0800
+        # 0x0013 means dewhitened, signal power valid, ref AA valid
+        # 0x0400 means CRC checked, 0x0800 CRC valid, neither known without CRC bytes
+        flags = 0x0013
+        if not truncated:
+            flags |= 0x0400
+            if not crc_err:
+                flags |= 0x0800
         if phy != 3:
             flags |= (phy & 0x3) << 14
         else:
@@ -145,23 +157,39 @@ class PcapBleWriter:
             ci_b = b''
 
         # BLE CRC is represented most significant bit first, sent least significant bit fist
-        crc_bytes = bytes([crc_rev & 0xFF, (crc_rev >> 8) & 0xFF, (crc_rev >> 16) & 0xFF])
+        if truncated:
+            crc_bytes = b''
+        else:
+            crc_bytes = bytes([crc_rev & 0xFF, (crc_rev >> 8) & 0xFF, (crc_rev >> 16) & 0xFF])
 
         payload_data = pack('<I', aa) + ci_b + packet + crc_bytes
         return payload_header + payload_data
 
     def write_packet(self, ts_usec, aa, chan, rssi, packet,
-            phy=0, pdu_type=0, aux_type=0, crc_rev=0, crc_err=False):
+            phy=0, pdu_type=0, aux_type=0, crc_rev=0, crc_err=False, orig_len=None,
+            ts_nsec=None):
         """
         Add packet to PCAP output.
 
         Basically, generates payload and encapsulates in a header.
+        If orig_len exceeds the length of packet, it is recorded as truncated.
+        ts_nsec, if given, takes precedence over ts_usec.
         """
-        ts_s = ts_usec // 1000000
-        ts_u = int(ts_usec - ts_s*1000000)
+        if ts_nsec is None:
+            ts_nsec = int(ts_usec) * 1000
+        ts_s = ts_nsec // 1000000000
+        ts_frac = ts_nsec - ts_s*1000000000
+        if not self.nanosecond:
+            ts_frac //= 1000
+        truncated = orig_len is not None and orig_len > len(packet)
         payload = self.payload(aa, packet, ble_to_rf_chan(chan), rssi,
-                               phy, pdu_type, aux_type, crc_rev, crc_err)
-        self.write_packet_header(ts_s, ts_u, len(payload))
+                               phy, pdu_type, aux_type, crc_rev, crc_err, truncated)
+        if truncated:
+            # missing body bytes plus 3 byte CRC
+            orig_size = len(payload) + orig_len - len(packet) + 3
+        else:
+            orig_size = None
+        self.write_packet_header(ts_s, ts_frac, len(payload), orig_size)
         self.output.write(payload)
 
     def write_packet_message(self, pkt: DPacketMessage):
@@ -176,7 +204,8 @@ class PcapBleWriter:
                 aux_type = 3
 
         self.write_packet(int(pkt.ts_epoch * 1000000), pkt.aa, pkt.chan, pkt.rssi,
-                pkt.body, pkt.phy, pdu_type, aux_type, pkt.crc_rev, pkt.crc_err)
+                pkt.body, pkt.phy, pdu_type, aux_type, pkt.crc_rev, pkt.crc_err, pkt.orig_len,
+                pkt.ts_epoch_ns)
 
     def close(self):
         """
@@ -201,8 +230,7 @@ class PcapBleReader:
 
     def read_header(self):
         expected_header = pack(
-            '<IHHIIII',
-            0xa1b2c3d4,
+            '<HHIIII',
             2,
             4,
             0,
@@ -210,6 +238,10 @@ class PcapBleReader:
             65535,
             self.DLT
         )
+        magic, = unpack('<I', self.input.read(4))
+        if magic not in (PCAP_MAGIC_USEC, PCAP_MAGIC_NSEC):
+            raise ValueError("Unexpected PCAP header")
+        self.nanosecond = magic == PCAP_MAGIC_NSEC
         read_header = self.input.read(len(expected_header))
         if read_header != expected_header:
             raise ValueError("Unexpected PCAP header")
@@ -220,14 +252,18 @@ class PcapBleReader:
         if len(hdr) < 16:
             raise EOFError
         ts_sec, ts_usec, size1, size2 = unpack('<IIII', hdr)
-        assert size1 == size2
+        if self.nanosecond:
+            ts_usec //= 1000
+        assert size1 <= size2
+        truncated = size1 < size2
 
         payload = self.input.read(size1)
 
         # Parse payload header
         rf_chan, rssi, _, _, aa, flags, _ = unpack('<BbbBIHI', payload[:14])
-        assert (flags & 0x0413) == 0x0413
-        crc_err = False if (flags & 0x0800) else True
+        assert (flags & 0x0013) == 0x0013
+        # CRC is not checked for truncated packets
+        crc_err = (flags & 0x0C00) == 0x0400
         phy = PhyMode(flags >> 14)
         pdu_type = (flags & 0x0380) >> 15
         assert pdu_type < 4 # isochronous unsupported for now
@@ -240,15 +276,22 @@ class PcapBleReader:
             if coding == 1:
                 phy = PhyMode.PHY_CODED_S2
 
-        body = payload[body_idx:-3]
-        crc_rev = payload[-3] + (payload[-2] << 8) + (payload[-1] << 16)
-        assert len(body) == body[1] + 2
+        if truncated:
+            # truncated packets lack CRC bytes
+            body = payload[body_idx:]
+            crc_rev = None
+            orig_len = len(body) + size2 - size1 - 3
+        else:
+            body = payload[body_idx:-3]
+            crc_rev = payload[-3] + (payload[-2] << 8) + (payload[-1] << 16)
+            assert len(body) == body[1] + 2
+            orig_len = len(body)
 
         ts32 = (ts_sec*1000000 + ts_usec) & 0x3FFFFFFF
         chan = rf_to_ble_chan(rf_chan)
         peripheral_send = True if pdu_type == 3 else False
 
-        pkt = PacketMessage.from_fields(ts32, len(body), 0, rssi, chan, phy, body,
+        pkt = PacketMessage.from_fields(ts32, orig_len, 0, rssi, chan, phy, body,
                                         crc_rev, crc_err, self.decoder_state, peripheral_send)
         try:
             return DPacketMessage.decode(pkt, self.decoder_state)
@@ -0,0 +1,161 @@
+# Written by Sultan Qasim Khan
+# Copyright (c) 2024, NCC Group plc
+# Released as open source under GPLv3
+
+# Capture pipeline that keeps the sniffer link drained while messages are
+# decoded, printed or written out. A reader thread only receives raw messages,
+# a decode thread turns them into message objects, and the caller iterating
+# over the pipeline is the sink. Stages are joined by bounded queues.
+#
+# If the sink falls behind, the decode thread blocks on the output queue and
+# the raw queue fills up. The reader then drops BLE frames rather than stall,
+# so the firmware's UART buffer never overflows. Frames that decoding depends
+# on are never dropped: CONNECT_IND on primary advertising channels, and
+# extended advertising and its connection setup on secondary channels. Nor are
+# other messages, such as state changes.
+
+from queue import Queue, Empty, Full
+from threading import Thread
+from time import perf_counter
+from .errors import SourceDone
+from .framing import MESSAGE_BLEFRAME, MESSAGE_BLEFRAME_EXT
+from .packet_decoder import PacketMessage
+
+RAW_QUEUE_LEN = 8192
+OUT_QUEUE_LEN = 1024
+
+# marks the end of the stream in the queues
+_DONE = object()
+
+# PDU types the decoder follows connections and advertising chains with.
+# On secondary channels these are AUX_CONNECT_REQ, the AUX_* PDUs with an
+# extended header (type 7), and AUX_CONNECT_RSP. Secondary channels can't be
+# told apart from data channels here, so data PDUs whose header happens to
+# match are kept too. Those are mostly LL control PDUs, which are rare.
+_KEEP_PRIMARY = (0x5,) # CONNECT_IND
+_KEEP_SECONDARY = (0x3, 0x7, 0x8)
+
+def _droppable(msg):
+    # raw messages from SniffleHW are tuples, SDR sources provide packets directly
+    if isinstance(msg, tuple):
+        if msg[0] not in (MESSAGE_BLEFRAME, MESSAGE_BLEFRAME_EXT) or msg[1] is None:
+            return False
+        chan = msg[5] & 0x3F
+        body = msg[6]
+    elif isinstance(msg, PacketMessage):
+        chan = msg.chan
+        body = msg.body
+    else:
+        return False
+
+    if not body:
+        return True
+    pdu_type = body[0] & 0xF
+    if chan >= 37:
+        return pdu_type not in _KEEP_PRIMARY
+    return pdu_type not in _KEEP_SECONDARY
+
+class CapturePipeline:
+    def __init__(self, hw, raw_len=RAW_QUEUE_LEN, out_len=OUT_QUEUE_LEN):
+        self.hw = hw
+        self.rawq = Queue(raw_len)
+        self.outq = Queue(out_len)
+        self.error = None
+        self.stopped = False
+        self.reader = Thread(target=self._read_worker, daemon=True)
+        self.decoder = Thread(target=self._decode_worker, daemon=True)
+
+        # statistics
+        self.received = 0
+        self.dropped = 0
+        self.decoded = 0
+        self.raw_max = 0
+        self.out_max = 0
+        self.decode_stall = 0.
+
+    def start(self):
+        self.reader.start()
+        self.decoder.start()
+
+    # Safe to call from signal handlers and other threads.
+    # Messages already queued are still delivered.
+    def stop(self):
+        self.stopped = True
+        self.hw.cancel_recv()
+
+    def _read_worker(self):
+        try:
+            while not self.stopped:
+                msg = self.hw.recv_msg()
+                if msg is None:
+                    break # receive cancelled
+                self.received += 1
+
+                if _droppable(msg):
+                    try:
+                        self.rawq.put_nowait(msg)
+                    except Full:
+                        self.dropped += 1
+                        continue
+                else:
+                    self.rawq.put(msg)
+
+                depth = self.rawq.qsize()
+                if depth > self.raw_max:
+                    self.raw_max = depth
+        except SourceDone:
+            pass
+        except BaseException as e:
+            self.error = e
+        finally:
+            self.rawq.put(_DONE)
+
+    def _decode_worker(self):
+        while True:
+            raw = self.rawq.get()
+            if raw is _DONE:
+                break
+            msg = self.hw.decode_msg(raw)
+            if msg is None:
+                continue
+            self.decoded += 1
+
+            try:
+                self.outq.put_nowait(msg)
+            except Full:
+                t0 = perf_counter()
+                self.outq.put(msg)
+                self.decode_stall += perf_counter() - t0
+
+            depth = self.outq.qsize()
+            if depth > self.out_max:
+                self.out_max = depth
+
+        self.outq.put(_DONE)
+
+    # Yields decoded messages until stopped or the source ends.
+    # Re-raises any exception that ended the reader.
+    def __iter__(self):
+        while True:
+            # poll so KeyboardInterrupt gets delivered on all platforms
+            try:
+                msg = self.outq.get(timeout=0.1)
+            except Empty:
+                continue
+            if msg is _DONE:
+                break
+            yield msg
+
+        if self.error:
+            raise self.error
+
+    def stats(self):
+        return {'received': self.received, 'dropped': self.dropped, 'decoded': self.decoded,
+                'raw_max': self.raw_max, 'out_max': self.out_max,
+                'decode_stall': self.decode_stall}
+
+    def __str__(self):
+        return ("Pipeline: %d received, %d dropped, %d decoded, max queue depth %d raw, "
+                "%d decoded, decode stalled %.2f s") % (
+                self.received, self.dropped, self.decoded, self.raw_max, self.out_max,
+                self.decode_stall)
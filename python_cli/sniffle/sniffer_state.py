@@ -23,6 +23,12 @@ class StateMessage:
         self.new_state = SnifferState(raw_msg[0])
         dstate.last_state = self.new_state
 
+        # firmware only follows other connections alongside the main one
+        if self.new_state != SnifferState.DATA:
+            dstate.secondary_conns.clear()
+        else:
+            dstate.conn_ind_expected = True
+
     def __repr__(self):
         return "%s(new=%s, old=%s)" % (type(self).__name__,
                 self.new_state.name, self.last_state.name)
@@ -5,18 +5,22 @@
 import sys
 from serial import Serial, SerialTimeoutException
 from struct import pack, unpack
-from base64 import b64encode, b64decode
-from binascii import Error as BAError
+from base64 import b64encode
 from time import time
 from random import randint, randrange
 from serial.tools.list_ports import comports
 from traceback import format_exception
 from os.path import realpath
-from .measurements import MeasurementMessage, VersionMeasurement
+from collections import deque
+from .measurements import MeasurementMessage, VersionMeasurement, ConnMeasurement, \
+        MacListMeasurement
 from .constants import BLE_ADV_AA, BLE_ADV_CRCI, SnifferMode, PhyMode
 from .sniffer_state import StateMessage, SnifferState
 from .decoder_state import SniffleDecoderState
-from .packet_decoder import PacketMessage, DPacketMessage
+from .packet_decoder import PacketMessage, DPacketMessage, FRAME_HDR_VERSION
+from .cobs import frame_encode
+from .framing import RxBuffer
+from .crc_ble import rbit24
 from .errors import SniffleHWPacketError, UsageError
 
 class TrivialLogger:
@@ -100,7 +104,7 @@ def make_sniffle_hw(serport=None, logger=None, timeout=None):
 
 class SniffleHW:
     max_interval_preload_pairs = 4
-    api_level = 0
+    api_level = 2
 
     def __init__(self, serport=None, logger=None, timeout=None):
         baud = 2000000
@@ -121,13 +125,23 @@ class SniffleHW:
         self.decoder_state = SniffleDecoderState()
         self.ser = Serial(serport, baud, timeout=timeout)
         self.recv_cancelled = False
+        self.rx_buf = RxBuffer()
+        self.rx_msgs = deque()
+        self.binary_framing = False
+        self.ext_timestamps = False
         self.logger = logger if logger else TrivialLogger()
         self.cmd_marker(b'@') # command sync
+        self.cmd_framing(False) # in case a previous session left binary framing on
+        self.cmd_ext_timestamps(False) # likewise for extended timestamps
 
     def _send_cmd(self, cmd_byte_list):
         b0 = (len(cmd_byte_list) + 3) // 3
         cmd = bytes([b0, *cmd_byte_list])
-        msg = b64encode(cmd) + b'\r\n'
+        if self.binary_framing:
+            # leading delimiter tells firmware this isn't base64
+            msg = b'\x00' + frame_encode(cmd)
+        else:
+            msg = b64encode(cmd) + b'\r\n'
         self.ser.write(msg)
 
     # Passively listen on specified channel and PHY for PDUs with specified access address
@@ -165,6 +179,32 @@ class SniffleHW:
                 # unnecessary/detrimental with extended advertising
                 self._send_cmd([0x14])
 
+    # Filter advertisements by a list of MACs (each 6 bytes, little endian like cmd_mac),
+    # as an allowlist or, if deny is set, a denylist. None disables the list filter.
+    # Firmware holds at least 96 MACs, more on parts with larger SRAM. Longer lists
+    # raise UsageError, since the extra MACs would not be filtered.
+    # The list filter replaces any MAC or IRK filter. Requires API level 1.
+    # Call before receiving starts, as this reads the capacity the firmware reports.
+    def cmd_mac_list(self, macs=None, deny=False):
+        if macs is not None:
+            macs = list(dict.fromkeys(bytes(m) for m in macs))
+            for m in macs:
+                if len(m) != 6:
+                    raise ValueError("MAC must be 6 bytes!")
+
+        self._send_cmd([0x2D])
+        if macs is None:
+            return
+
+        capacity = self._recv_mac_list_capacity()
+        if capacity is not None and len(macs) > capacity:
+            raise UsageError("MAC list has %d MACs, but firmware holds at most %d" % (
+                len(macs), capacity))
+        # load incrementally, in chunks that fit in a command message
+        for i in range(0, len(macs), 40):
+            self._send_cmd([0x2E, *b''.join(macs[i:i+40])])
+        self._send_cmd([0x2F, 2 if deny else 1])
+
     # Should CONNECT_IND PDUs cause the sniffer to follow the connection
     def cmd_follow(self, enable=True):
         if enable:
@@ -233,15 +273,20 @@ class SniffleHW:
         self._send_cmd([0x1D, intervalMs & 0xFF, intervalMs >> 8])
 
     # Specify an Identity Resolving Key to identify RPAs of the target
+    # irk may also be a list of up to 8 IRKs (API level 1) to match any of several targets
     def cmd_irk(self, irk=None, hop3=True):
         if irk is None:
             self._send_cmd([0x1E])
-        elif len(irk) != 16:
-            raise ValueError("Invalid IRK length!")
-        else:
-            self._send_cmd([0x1E, *irk])
-            if hop3:
-                self._send_cmd([0x14])
+            return
+        irks = [irk] if isinstance(irk, (bytes, bytearray)) else list(irk)
+        if not (1 <= len(irks) <= 8):
+            raise ValueError("Must specify between 1 and 8 IRKs!")
+        for k in irks:
+            if len(k) != 16:
+                raise ValueError("Invalid IRK length!")
+        self._send_cmd([0x1E, *b''.join(bytes(k) for k in irks)])
+        if hop3:
+            self._send_cmd([0x14])
 
     # Should the sniffer immediately hop to the next channel in the connection hop sequence
     # when central and peripheral stop talking in the current connection event, rather than waiting
@@ -316,90 +361,172 @@ class SniffleHW:
             raise ValueError("TX power out of bounds")
         self._send_cmd([0x27, power & 0xFF])
 
+    # Select the framing firmware uses for messages it sends: base64+CRLF (default),
+    # or COBS with a CRC16 trailer and zero delimiter (binary), requiring API level 1.
+    # Use enable_binary_framing rather than calling this directly.
+    def cmd_framing(self, binary=False):
+        self._send_cmd([0x28, 1 if binary else 0])
+
+    # Select 64 bit 0.25 us frame and marker timestamps in a versioned header instead of
+    # 32 bit microseconds that wrap. Requires API level 2.
+    # Use enable_ext_timestamps rather than calling this directly.
+    def cmd_ext_timestamps(self, enable=False):
+        self._send_cmd([0x33, 1 if enable else 0])
+
+    # Switch to extended timestamps if the firmware supports them.
+    # Returns True if extended timestamps were enabled.
+    def enable_ext_timestamps(self):
+        ver_msg = self.probe_fw_version()
+        if ver_msg is None or ver_msg.api_level < 2:
+            return False
+        self.cmd_ext_timestamps(True)
+        self.ext_timestamps = True
+        # zero time is taken from the first extended marker
+        self.mark_and_flush()
+        return True
+
+    # Switch the link to binary framing if the firmware supports it.
+    # Returns True if binary framing was enabled.
+    def enable_binary_framing(self):
+        ver_msg = self.probe_fw_version()
+        if ver_msg is None or ver_msg.api_level < 1:
+            return False
+        self.cmd_framing(True)
+        self.binary_framing = True
+        # discard base64 messages sent before the switch
+        self.mark_and_flush()
+        return True
+
+    # Ask firmware to report how many frames it has sent per UART write
+    def cmd_txbatch_stats(self):
+        self._send_cmd([0x29])
+
+    # Ask firmware to report its performance counters
+    def cmd_counters(self):
+        self._send_cmd([0x2A])
+
+    # Limit how many PDU bytes firmware forwards for a PDU type; 0 means no limit.
+    # pdu_type is the 4 bit advertising PDU type, "data" for data channel PDUs,
+    # or None to apply to all types. Requires API level 1.
+    def cmd_snaplen(self, snaplen=0, pdu_type=None):
+        if pdu_type is None:
+            ptype = 0xFF
+        elif pdu_type == "data":
+            ptype = 16
+        elif 0 <= pdu_type <= 15:
+            ptype = pdu_type
+        else:
+            raise ValueError("Invalid PDU type")
+        if snaplen != 0 and not (2 <= snaplen <= 255):
+            raise ValueError("Snaplen must be 0 or in [2, 255]")
+        self._send_cmd([0x2B, ptype, snaplen])
+
+    # Forward only the first copy of identical legacy advertisements seen within
+    # window_ms, followed by a DedupMeasurement summarizing the repeats.
+    # 0 disables deduplication. Requires API level 1.
+    def cmd_dedup(self, window_ms=0):
+        if not (0 <= window_ms <= 0xFFFF):
+            raise ValueError("Dedup window out of bounds")
+        self._send_cmd([0x2C, *list(pack("<H", window_ms))])
+
+    # Time firmware software AES over the given number of blocks, against the
+    # reference implementation, and cross-check their outputs. Firmware replies
+    # with an AesBenchMeasurement. Blocks the command task while running.
+    def cmd_aes_bench(self, blocks=256):
+        if not (1 <= blocks <= 0xFFFF):
+            raise ValueError("Block count out of bounds")
+        self._send_cmd([0x30, *list(pack("<H", blocks))])
+
+    # Request the firmware hop latency histogram, optionally clearing it afterwards.
+    # Firmware replies with a HopLatencyMeasurement.
+    def cmd_hop_latency(self, reset=False):
+        self._send_cmd([0x31, 1 if reset else 0])
+
+    # Also follow connections established while following one, between its
+    # events. Packets of those connections carry a non-zero conn index.
+    def cmd_multi_conn(self, enable=True):
+        self._send_cmd([0x32, 1 if enable else 0])
+
+    # Report scheduled vs. actual radio time of every timed hop and stop trigger
+    def cmd_trig_jitter(self, enable=True):
+        self._send_cmd([0x34, 1 if enable else 0])
+
+    # Returns (mtype, ts, len_dir, event, rssi, chan_phy, body) as from
+    # framing.parse_messages, with mtype -1 if the receive was cancelled.
     def _recv_msg(self, desync=False):
-        got_msg = False
-        while not (got_msg or self.recv_cancelled):
-            if desync:
-                # readline is inefficient, but a good way to synchronize
-                pkt = self.ser.readline()
-                try:
-                    data = b64decode(pkt.rstrip())
-                except BAError as e:
-                    continue
-                if len(data) < 2:
-                    continue
-            else:
-                # minimum packet is 4 bytes base64 + 2 bytes CRLF
-                pkt = self.ser.read(6)
-
-                # avoid error in case read was aborted
-                if len(pkt) < 6:
-                    if self.timeout:
-                        raise SerialTimeoutException()
-                    else:
-                        continue
-
-                # decode header to get length byte
-                try:
-                    data = b64decode(pkt[:4])
-                except BAError as e:
-                    self.logger.warning("Ignoring message due to decode error: %s", e)
-                    self.logger.warning("Message: %s", pkt)
-                    self.ser.readline() # eat CRLF
-                    continue
-
-                # In case pkt was all whitespace
-                if len(data) < 2:
-                    continue
-
-                # now read the rest of the packet (if there is anything)
-                word_cnt = data[0]
-                if word_cnt:
-                    pkt += self.ser.read((word_cnt - 1) * 4)
-
-                # make sure CRLF is present
-                if pkt[-2:] != b'\r\n':
-                    self.logger.warning("Ignoring message due to missing CRLF")
-                    self.logger.warning("Message: %s", pkt)
-                    self.ser.readline() # eat CRLF
+        while not (self.rx_msgs or self.recv_cancelled):
+            # avoid error in case read was aborted
+            if self.rx_buf.fill(self.ser) == 0:
+                if self.timeout:
+                    raise SerialTimeoutException()
+                else:
                     continue
 
-                try:
-                    data = b64decode(pkt[:-2])
-                except BAError as e:
-                    self.logger.warning("Ignoring message due to decode error: %s", e)
-                    self.logger.warning("Message: %s", pkt)
-                    self.ser.readline() # eat CRLF
-                    continue
+            # malformed or partial messages are skipped, so this also resynchronizes
+            msgs, errors, discarded = self.rx_buf.parse(self.binary_framing)
+            self.rx_msgs.extend(msgs)
 
-            got_msg = True
+            if desync:
+                continue
+            if errors:
+                self.logger.warning("Ignoring %d message(s) due to decode errors", errors)
+            if discarded:
+                self.logger.warning("Discarding %d bytes without message delimiter", discarded)
 
         if self.recv_cancelled:
             self.recv_cancelled = False
-            return -1, None, b''
+            return -1, None, 0, 0, 0, 0, b''
 
-        # msg type, msg body, raw
-        return data[1], data[2:], pkt
+        return self.rx_msgs.popleft()
+
+    # Host receive statistics: (serial reads, bytes read, messages parsed) so far
+    def rx_stats(self):
+        return self.rx_buf.reads, self.rx_buf.bytes, self.rx_buf.msgs
 
     def recv_and_decode(self, desync=False):
-        mtype, mbody, msg = self._recv_msg(desync)
+        return self.decode_msg(self._recv_msg(desync), desync)
+
+    # recv_msg and decode_msg split recv_and_decode in two, so that receiving
+    # can run separately from decoding, as in CapturePipeline.
+    # Returns None if the receive was cancelled.
+    def recv_msg(self):
+        msg = self._recv_msg()
+        return None if msg[0] == -1 else msg
+
+    def decode_msg(self, msg, desync=False):
+        mtype, ts, l, event, rssi, chan, mbody = msg
         try:
-            if mtype == 0x10:
-                pkt = PacketMessage(mbody, self.decoder_state)
+            if mtype in (0x10, 0x15): # 0x15 has extended timestamp header
+                if ts is None:
+                    # header couldn't be unpacked, this raises the reason
+                    pkt = PacketMessage(mbody, self.decoder_state, ext_ts=(mtype == 0x15))
+                else:
+                    pkt = PacketMessage.from_header(ts, l, event, rssi, chan, mbody,
+                            self.decoder_state, ext_ts=(mtype == 0x15))
                 try:
                     return DPacketMessage.decode(pkt, self.decoder_state)
                 except BaseException as e:
-                    self.logger.warning("Skipping decode due to exception: %s", e, exc_info=e)
-                    self.logger.warning("Packet: %s", pkt)
+                    # truncated packets can legitimately lack fields, and a small
+                    # snaplen would flood the log, so pass them on undecoded quietly
+                    if not pkt.truncated:
+                        self.logger.warning("Skipping decode due to exception: %s", e, exc_info=e)
+                        self.logger.warning("Packet: %s", pkt)
                     return pkt
             elif mtype == 0x11:
                 return DebugMessage(mbody)
-            elif mtype == 0x12:
-                return MarkerMessage(mbody, self.decoder_state)
+            elif mtype in (0x12, 0x16):
+                return MarkerMessage(mbody, self.decoder_state, ext_ts=(mtype == 0x16))
             elif mtype == 0x13:
                 return StateMessage(mbody, self.decoder_state)
             elif mtype == 0x14:
-                return MeasurementMessage.from_raw(mbody)
+                meas = MeasurementMessage.from_raw(mbody)
+                if isinstance(meas, ConnMeasurement):
+                    if meas.reason == ConnMeasurement.LOST:
+                        self.decoder_state.secondary_conns.pop(meas.conn, None)
+                    elif meas.reason != ConnMeasurement.REJECTED:
+                        self.decoder_state.secondary_conns[meas.conn] = (
+                                meas.aa, rbit24(meas.crc_init))
+                return meas
             elif mtype == -1:
                 return None # receive cancelled
             else:
@@ -407,7 +534,7 @@ class SniffleHW:
         except BaseException as e:
             if not desync:
                 self.logger.warning("Ignoring message due to exception: %s", e, exc_info=e)
-                self.logger.warning("Message: %s", msg)
+                self.logger.warning("Message: %s", mbody)
             return None
 
     def cancel_recv(self):
@@ -425,6 +552,15 @@ class SniffleHW:
             if isinstance(msg, MarkerMessage) and msg.marker_data == marker_data:
                 recvd_mark = True
 
+    # Capacity reported by firmware when the MAC list is cleared, None if not reported
+    def _recv_mac_list_capacity(self):
+        etime = time() + 0.2
+        while time() < etime:
+            msg = self.recv_and_decode(True)
+            if isinstance(msg, MacListMeasurement):
+                return msg.capacity
+        return None
+
     def probe_fw_version(self):
         self.cmd_version()
         etime = time() + 0.2
@@ -549,7 +685,17 @@ class DebugMessage:
         return "DEBUG: " + self.msg
 
 class MarkerMessage:
-    def __init__(self, raw_msg, dstate):
+    def __init__(self, raw_msg, dstate, ext_ts=False):
+        if ext_ts:
+            if raw_msg[0] != FRAME_HDR_VERSION:
+                raise SniffleHWPacketError("Unsupported marker header version %d" % raw_msg[0])
+            ticks, = unpack("<Q", raw_msg[1:9])
+            self.marker_data = raw_msg[9:]
+
+            # these messages are intended to mark the zero time
+            dstate.set_zero_ticks(ticks)
+            return
+
         ts, = unpack("<L", raw_msg[:4])
         self.marker_data = raw_msg[4:]
 
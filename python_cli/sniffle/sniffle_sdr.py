@@ -21,7 +21,7 @@ from .errors import SniffleHWPacketError, UsageError
 from .sniffle_hw import TrivialLogger
 from .sdr_utils import decimate, unpack_syms, calc_rssi, resample, fm_demod2, ExactSyncDetector
 from .whitening_ble import le_dewhiten
-from .crc_ble import rbit24, crc_ble_reverse
+from .crc_ble import rbit24, crc_ble_reverse_batch
 from .pcap import rf_to_ble_chan, ble_to_rf_chan
 from .channelizer import PolyphaseChannelizer
 from .resampler import PolyphaseResampler
@@ -75,6 +75,7 @@ class ChannelProcessor:
         samples_demod = fm_demod2(samples) > 0
         syncs = self.sync_detector.feed(samples_demod)
         pkts_raw = self.ble_pkt_extract(samples_demod, syncs, self.chan, self.samps_per_sym)
+        crcs = crc_ble_reverse_batch(self.crci_rev, [p[:-3] for p in pkts_raw])
         pkts = []
         for i, p in enumerate(pkts_raw):
             pkt_duration = (len(p) + 4) * 8 * 2 # 2 SPS, pkt doesn't include sync word
@@ -82,7 +83,7 @@ class ChannelProcessor:
             pkt_samples = samples[s0:syncs[i] + pkt_duration]
             rssi = int(calc_rssi(pkt_samples) - self.gain)
             t_sync = self.t_start + (self.sample_counter + syncs[i]) / self.fs
-            pkt = self.process_pkt(self.chan, t_sync, p, rssi)
+            pkt = self.process_pkt(self.chan, t_sync, p, rssi, crcs[i])
             pkts.append(pkt)
         self.sample_counter += len(samples)
         return pkts
@@ -105,11 +106,11 @@ class ChannelProcessor:
                 pkts.append(le_dewhiten(raw[:pkt_len], chan))
         return pkts
 
-    def process_pkt(self, chan, t_sync, pkt, rssi):
+    # crc_calc is the CRC computed over the body
+    def process_pkt(self, chan, t_sync, pkt, rssi, crc_calc):
         body = pkt[:-3]
         crc_bytes = pkt[-3:]
         crc_rev = crc_bytes[0] | (crc_bytes[1] << 8) | (crc_bytes[2] << 16)
-        crc_calc = crc_ble_reverse(self.crci_rev, body)
         crc_err = (crc_calc != crc_rev)
         return _SDRPacket(t_sync, rssi, chan, self.phy, body, crc_rev, crc_err)
 
@@ -167,6 +168,8 @@ class SniffleSDR:
         self.phy = PhyMode.PHY_1M
         self.rssi_min = -128
         self.mac = None
+        self.mac_list = None
+        self.mac_list_deny = False
         self.validate_crc = True
 
         # TODO: consider attenuation from resampler in per-channel gain
@@ -196,6 +199,19 @@ class SniffleSDR:
             if len(mac_bytes) != 6:
                 raise ValueError("MAC must be 6 bytes!")
             self.mac = bytes(mac_bytes)
+        self.mac_list = None
+
+    # Specify (or clear) a list of MAC addresses to allow or deny
+    def cmd_mac_list(self, macs=None, deny=False):
+        self.mac = None
+        if macs is None:
+            self.mac_list = None
+        else:
+            for m in macs:
+                if len(m) != 6:
+                    raise ValueError("MAC must be 6 bytes!")
+            self.mac_list = set(bytes(m) for m in macs)
+        self.mac_list_deny = deny
 
     def cmd_crc_valid(self, validate=True):
         self.validate_crc = validate
@@ -268,6 +284,9 @@ class SniffleSDR:
                         continue
                     if self.mac and dpkt.AdvA != self.mac:
                         continue
+                    if self.mac_list is not None and \
+                            (dpkt.AdvA in self.mac_list) == self.mac_list_deny:
+                        continue
 
                 self.pktq.put(dpkt)
 
@@ -281,9 +300,39 @@ class SniffleSDR:
 
         return self.pktq.get()
 
+    # packets are decoded by the worker, see SniffleHW.recv_msg
+    def recv_msg(self):
+        return self.recv_and_decode()
+
+    def decode_msg(self, msg):
+        return msg
+
     def mark_and_flush(self):
         pass
 
+    def enable_binary_framing(self):
+        return False
+
+    def enable_ext_timestamps(self):
+        return False
+
+    def cmd_counters(self):
+        pass
+
+    def cmd_snaplen(self, snaplen=0, pdu_type=None):
+        pass
+
+    def cmd_dedup(self, window_ms=0):
+        pass
+
+    def cmd_multi_conn(self, enable=True):
+        if enable:
+            raise UsageError("Following multiple connections isn't supported with SDR sources")
+
+    # no serial port, so no reads, bytes, or framed messages to count
+    def rx_stats(self):
+        return 0, 0, 0
+
     def cancel_recv(self):
         if self.worker_started:
             self.worker_stopped = True
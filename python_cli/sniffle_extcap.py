@@ -42,6 +42,7 @@ from sniffle.sniffle_hw import make_sniffle_hw, PacketMessage, SnifferMode, PhyM
 from sniffle.packet_decoder import (DataMessage, AdvaMessage, AdvDirectIndMessage,
                             ScanRspMessage, AdvExtIndMessage, str_mac)
 from sniffle.pcap import PcapBleWriter
+from sniffle.pipeline import CapturePipeline
 from sniffle.errors import UsageError
 
 scriptName = os.path.basename(sys.argv[0])
@@ -65,6 +66,7 @@ class SniffleExtcapPlugin():
         self.args = None
         self.logger = None
         self.hw = None
+        self.pipeline = None
         self.captureStream = None
         self.controlReadStream = None
         self.controlWriteStream = None
@@ -411,19 +413,22 @@ class SniffleExtcapPlugin():
         signal.signal(signal.SIGINT, lambda sig, frame : self.stopCapture())
         signal.signal(signal.SIGTERM, lambda sig, frame : self.stopCapture())
 
-        # capture packets and write to the capture output until signaled to stop
-        while not self.captureStopped:
-            # wait for a capture packet
-            pkt = self.hw.recv_and_decode()
-            if isinstance(pkt, PacketMessage):
-                # write the packet to the PCAP writer
-                try:
-                    self.pcapWriter.write_packet_message(pkt)
-                except IOError: # Windows will raise this when the other end of the FIFO is closed
-                    self.captureStopped = True
-                    break
+        # capture packets and write to the capture output until signaled to stop,
+        # with the serial port read from a separate thread so FIFO writes can't stall it
+        self.pipeline = CapturePipeline(self.hw)
+        if not self.captureStopped:
+            self.pipeline.start()
+            for pkt in self.pipeline:
+                if isinstance(pkt, PacketMessage):
+                    # write the packet to the PCAP writer
+                    try:
+                        self.pcapWriter.write_packet_message(pkt)
+                    except IOError: # Windows will raise this when the other end of the FIFO is closed
+                        self.stopCapture()
+                        break
 
         self.logger.info('Capture stopped')
+        self.logger.info(str(self.pipeline))
 
     def open_pipes(self):
         # if a control-out FIFO has been given, open it for writing
@@ -528,8 +533,10 @@ class SniffleExtcapPlugin():
 
     def stopCapture(self):
         # interrupt the main thread if it is in the middle of receiving data
-        # from the capture hardware.
-        if self.hw:
+        # from the capture hardware, or the pipeline reading it during capture.
+        if self.pipeline:
+            self.pipeline.stop()
+        elif self.hw:
             self.hw.cancel_recv()
 
         # signal the main thread that capturing has been stopped